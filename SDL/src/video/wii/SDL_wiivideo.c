@@ -64,7 +64,10 @@ GXRModeObj* vmode = 0;
 u8 * screenTex = NULL; // screen capture
 static int quit_flip_thread = 0;
 static unsigned char texturemem[TEXTUREMEM_SIZE] __attribute__((aligned(32))); // GX texture
-static unsigned char textureconvert[TEXTUREMEM_SIZE] __attribute__((aligned(32))); // 565 mem
+// Direct textures are double buffered in texturemem: GX reads the shown one
+// while the application writes the other
+static unsigned char *textureshown = texturemem;
+static unsigned char *texturedrawn = texturemem;
 
 static void (*rendercallback)(void) = NULL;
 
@@ -112,6 +115,25 @@ static camera cam = {
 static int currentwidth;
 static int currentheight;
 static int currentbpp;
+static SDL_Rect texturerect; // Part of the screen stretched across the quad
+static int texturewidth;
+static int textureheight;
+static int texturesize;
+static int directtexture = 0; // Whether the application writes the texture
+static f32 squarescale[2] = {1.0F, 1.0F}; // Part of the quad the texture rect covers
+
+static void
+init_texobj ()
+{
+	if (directtexture || currentbpp == 8 || currentbpp == 16)
+		GX_InitTexObj (&texobj, textureshown, texturewidth, textureheight, GX_TF_RGB565, GX_CLAMP, GX_CLAMP, GX_FALSE);
+	else
+		GX_InitTexObj (&texobj, textureshown, texturewidth, textureheight, GX_TF_RGBA8, GX_CLAMP, GX_CLAMP, GX_FALSE);
+
+	// Direct textures are scaled up by GX, keep their pixels sharp
+	if (directtexture)
+		GX_InitTexObjLOD (&texobj, GX_NEAR, GX_NEAR, 0.0F, 0.0F, 0.0F, GX_FALSE, GX_FALSE, GX_ANISO_1);
+}
 
 static void
 draw_init ()
@@ -143,10 +165,7 @@ draw_init ()
 	GX_InvVtxCache ();	// update vertex cache
 
 	// initialize the texture obj we are going to use
-	if (currentbpp == 8 || currentbpp == 16)
-		GX_InitTexObj (&texobj, texturemem, currentwidth, currentheight, GX_TF_RGB565, GX_CLAMP, GX_CLAMP, GX_FALSE);
-	else
-		GX_InitTexObj (&texobj, texturemem, currentwidth, currentheight, GX_TF_RGBA8, GX_CLAMP, GX_CLAMP, GX_FALSE);
+	init_texobj ();
 
 	GX_LoadTexObj (&texobj, GX_TEXMAP0);	// load texture object so its ready to use
 }
@@ -166,15 +185,21 @@ draw_square (Mtx v)
 	Mtx mv;			// modelview matrix.
 
 	guMtxIdentity (m);
+	guMtxScaleApply (m, m, squarescale[0], squarescale[1], 1.0F);
 	guMtxTransApply (m, m, 0, 0, -200);
 	guMtxConcat (v, m, mv);
 
+	f32 s0 = (f32) texturerect.x / texturewidth;
+	f32 t0 = (f32) texturerect.y / textureheight;
+	f32 s1 = (f32) (texturerect.x + texturerect.w) / texturewidth;
+	f32 t1 = (f32) (texturerect.y + texturerect.h) / textureheight;
+
 	GX_LoadPosMtxImm (mv, GX_PNMTX0);
 	GX_Begin (GX_QUADS, GX_VTXFMT0, 4);
-	draw_vert (0, 0, 0.0, 0.0);
-	draw_vert (1, 0, 1.0, 0.0);
-	draw_vert (2, 0, 1.0, 1.0);
-	draw_vert (3, 0, 0.0, 1.0);
+	draw_vert (0, 0, s0, t0);
+	draw_vert (1, 0, s1, t0);
+	draw_vert (2, 0, s1, t1);
+	draw_vert (3, 0, s0, t1);
 	GX_End ();
 }
 
@@ -216,8 +241,9 @@ static void * flip_thread (void *arg)
 	  GX_SetVtxDesc (GX_VA_TEX0, GX_DIRECT);
     GX_SetTevOp (GX_TEVSTAGE0, GX_REPLACE);
 
-		// load texture into GX
-		DCFlushRange(texturemem, TEXTUREMEM_SIZE);
+		// load texture into GX (direct textures are flushed by the application)
+		if (!directtexture)
+			DCFlushRange(texturemem, texturesize);
 		GX_LoadTexObj(&texobj, GX_TEXMAP0);    
 
 		draw_square(gx_view); // render textured quad
@@ -391,6 +417,16 @@ static SDL_Surface *WII_SetVideoMode(_THIS, SDL_Surface *current,
 	currentwidth = current->w;
 	currentheight = current->h;
 	currentbpp = bpp;
+	directtexture = 0;
+	textureshown = texturedrawn = texturemem;
+	texturewidth = current->w;
+	textureheight = current->h;
+	texturesize = TEXTUREMEM_SIZE;
+	squarescale[0] = squarescale[1] = 1.0F;
+	texturerect.x = 0;
+	texturerect.y = 0;
+	texturerect.w = current->w;
+	texturerect.h = current->h;
 	WPAD_SetVRes(WPAD_CHAN_ALL, currentwidth*2, currentheight*2);
 	draw_init();
 	StartVideoThread();
@@ -521,6 +557,8 @@ static void UpdateRect_32(_THIS, SDL_Rect *rect)
 static void WII_UpdateRect(_THIS, SDL_Rect *rect)
 {
 	const SDL_Surface* const screen = this->screen;
+	if (directtexture)
+		return;
 	SDL_mutexP(videomutex);
 	switch(screen->format->BytesPerPixel) {
 	case 1:
@@ -551,112 +589,58 @@ static void WII_UpdateRects(_THIS, int numrects, SDL_Rect *rects)
 	}
 }
 
+/* Converts and tiles only the 4x4 texture tiles covered by the texture rect */
 static void flipHWSurface_8_16(_THIS, SDL_Surface *surface)
 {
-  //SDL_mutexP(videomutex);
-
-	int new_pitch = this->hidden->width * 2;
-	long long int *dst = (long long int *) texturemem;
-	long long int *src1 = (long long int *) textureconvert;
-	long long int *src2 = (long long int *) (textureconvert + new_pitch);
-	long long int *src3 = (long long int *) (textureconvert + (new_pitch * 2));
-	long long int *src4 = (long long int *) (textureconvert + (new_pitch * 3));
-	int rowpitch = (new_pitch >> 3) * 3;
-	int rowadjust = (new_pitch % 8) * 4;
+	int width = this->hidden->width;
+	int tx0 = texturerect.x >> 2;
+	int tx1 = (texturerect.x + texturerect.w + 3) >> 2;
+	int ty0 = texturerect.y >> 2;
+	int ty1 = (texturerect.y + texturerect.h + 3) >> 2;
 	Uint16 *palette = this->hidden->palette;
-	char *ra = NULL;
-	int h, w;
-
-	// crude convert
-	Uint16 * ptr_cv = (Uint16 *) textureconvert;
-	Uint8 *ptr = (Uint8 *)this->hidden->buffer;
+	int tx, ty, y;
 
-	for (h = 0; h < this->hidden->height; h++)
+	for (ty = ty0; ty < ty1; ty++)
 	{
-		for (w = 0; w < this->hidden->width; w++)
+		for (tx = tx0; tx < tx1; tx++)
 		{
-			Uint16 v = palette[*ptr];
-
-			*ptr_cv++ = v;
-			ptr++;
+			Uint16 *dst = (Uint16 *) texturemem + (((ty * (width >> 2)) + tx) << 4);
+			Uint8 *src = (Uint8 *) this->hidden->buffer + ((ty << 2) * width) + (tx << 2);
+			for (y = 0; y < 4; y++)
+			{
+				dst[0] = palette[src[0]];
+				dst[1] = palette[src[1]];
+				dst[2] = palette[src[2]];
+				dst[3] = palette[src[3]];
+				dst += 4;
+				src += width;
+			}
 		}
 	}
-
-	// same as 16bit
-	for (h = 0; h < this->hidden->height; h += 4)
-	{
-		for (w = 0; w < (this->hidden->width >> 2); w++)
-		{
-			*dst++ = *src1++;
-			*dst++ = *src2++;
-			*dst++ = *src3++;
-			*dst++ = *src4++;
-		}
-
-		src1 += rowpitch;
-		src2 += rowpitch;
-		src3 += rowpitch;
-		src4 += rowpitch;
-
-		if ( rowadjust )
-		{
-			ra = (char *)src1;
-			src1 = (long long int *)(ra + rowadjust);
-			ra = (char *)src2;
-			src2 = (long long int *)(ra + rowadjust);
-			ra = (char *)src3;
-			src3 = (long long int *)(ra + rowadjust);
-			ra = (char *)src4;
-			src4 = (long long int *)(ra + rowadjust);
-		}
-	}
-
-  //SDL_mutexV(videomutex);
 }
 
 static void flipHWSurface_16_16(_THIS, SDL_Surface *surface)
 {
-  //SDL_mutexP(videomutex);
-
-	int h, w;
-	long long int *dst = (long long int *) texturemem;
-	long long int *src1 = (long long int *) this->hidden->buffer;
-	long long int *src2 = (long long int *) (this->hidden->buffer + this->hidden->pitch);
-	long long int *src3 = (long long int *) (this->hidden->buffer + (this->hidden->pitch * 2));
-	long long int *src4 = (long long int *) (this->hidden->buffer + (this->hidden->pitch * 3));
-	int rowpitch = (this->hidden->pitch >> 3) * 3;
-	int rowadjust = (this->hidden->pitch % 8) * 4;
-	char *ra = NULL;
+	int pitch = this->hidden->pitch;
+	int tx0 = texturerect.x >> 2;
+	int tx1 = (texturerect.x + texturerect.w + 3) >> 2;
+	int ty0 = texturerect.y >> 2;
+	int ty1 = (texturerect.y + texturerect.h + 3) >> 2;
+	int tx, ty, y;
 
-	for (h = 0; h < this->hidden->height; h += 4)
+	for (ty = ty0; ty < ty1; ty++)
 	{
-		for (w = 0; w < this->hidden->width; w += 4)
-		{
-			*dst++ = *src1++;
-			*dst++ = *src2++;
-			*dst++ = *src3++;
-			*dst++ = *src4++;
-		}
-
-		src1 += rowpitch;
-		src2 += rowpitch;
-		src3 += rowpitch;
-		src4 += rowpitch;
-
-		if ( rowadjust )
+		for (tx = tx0; tx < tx1; tx++)
 		{
-			ra = (char *)src1;
-			src1 = (long long int *)(ra + rowadjust);
-			ra = (char *)src2;
-			src2 = (long long int *)(ra + rowadjust);
-			ra = (char *)src3;
-			src3 = (long long int *)(ra + rowadjust);
-			ra = (char *)src4;
-			src4 = (long long int *)(ra + rowadjust);
+			long long int *dst = (long long int *) texturemem + (((ty * (this->hidden->width >> 2)) + tx) << 2);
+			Uint8 *src = (Uint8 *) this->hidden->buffer + ((ty << 2) * pitch) + (tx << 3);
+			for (y = 0; y < 4; y++)
+			{
+				*dst++ = *(long long int *) src;
+				src += pitch;
+			}
 		}
 	}
-
-  //SDL_mutexV(videomutex);
 }
 
 static void flipHWSurface_24_16(_THIS, SDL_Surface *surface)
@@ -673,6 +657,10 @@ static void flipHWSurface_32_16(_THIS, SDL_Surface *surface)
 
 static int WII_FlipHWSurface(_THIS, SDL_Surface *surface)
 {
+	// The application writes the texture itself
+	if (directtexture)
+		return 1;
+
 	switch(surface->format->BytesPerPixel)
 	{
 		case 1:
@@ -875,6 +863,98 @@ void WII_ChangeSquare(int xscale, int yscale, int xshift, int yshift)
 	DCFlushRange (square, 32); // update memory BEFORE the GPU accesses it!
 }
 
+/* Has GX read a width x height RGB565 texture that the application writes
+ * directly in the 4x4 tiled layout, the texture rect covering xscale x yscale
+ * of the quad. The texture is double buffered, the application writes one
+ * while the other is shown. Returns the (cleared) texture to write, NULL if 
+ * the two do not fit. */
+void *WII_SetDirectTexture(int width, int height, f32 xscale, f32 yscale)
+{
+	int size = ((width * height * 2) + 31) & ~31;
+	if ((size * 2) > TEXTUREMEM_SIZE)
+		return NULL;
+
+	SDL_mutexP(videomutex);
+	directtexture = 1;
+	texturewidth = width;
+	textureheight = height;
+	texturesize = width * height * 2;
+	textureshown = texturemem;
+	texturedrawn = texturemem + size;
+	squarescale[0] = xscale;
+	squarescale[1] = yscale;
+	texturerect.x = 0;
+	texturerect.y = 0;
+	texturerect.w = width;
+	texturerect.h = height;
+	memset(texturemem, 0, size * 2);
+	DCFlushRange(texturemem, size * 2);
+	init_texobj();
+	SDL_mutexV(videomutex);
+	return texturedrawn;
+}
+
+/* Shows the direct texture the application has written (and flushed), the
+ * rect being the part of it stretched across the quad. The swap is made 
+ * between two flips so that a frame is never shown half written. Returns
+ * the texture to write next, it holds the frame shown before. */
+void *WII_PresentTexture(int x, int y, int w, int h)
+{
+	unsigned char *shown;
+
+	if (!directtexture)
+		return NULL;
+
+	SDL_mutexP(videomutex);
+	shown = textureshown;
+	textureshown = texturedrawn;
+	texturedrawn = shown;
+	texturerect.x = x;
+	texturerect.y = y;
+	texturerect.w = w;
+	texturerect.h = h;
+	init_texobj();
+	SDL_mutexV(videomutex);
+	return texturedrawn;
+}
+
+/* Flushes the rows of tiles of the direct texture being written covering 
+ * rows y to y + h, for GX to read what the application wrote there */
+void WII_FlushTexture(int y, int h)
+{
+	int pitch = texturewidth * 2 * 4; // A row of tiles
+	int first = y >> 2;
+	int last = (y + h + 3) >> 2;
+
+	if (!directtexture)
+		return;
+	if (last > (textureheight >> 2))
+		last = textureheight >> 2;
+	if (last > first)
+		DCFlushRange(texturedrawn + (first * pitch), (last - first) * pitch);
+}
+
+/* Copies the rows of tiles covering rows y to y + h from the shown direct
+ * texture to the one being written (and flushes them), so both hold the
+ * rows that changed in the frame just shown */
+void WII_CopyTexture(int y, int h)
+{
+	int pitch = texturewidth * 2 * 4; // A row of tiles
+	int first = y >> 2;
+	int last = (y + h + 3) >> 2;
+
+	if (!directtexture)
+		return;
+	if (last > (textureheight >> 2))
+		last = textureheight >> 2;
+	if (last > first)
+	{
+		memcpy(texturedrawn + (first * pitch), textureshown + (first * pitch), 
+			(last - first) * pitch);
+		DCFlushRange(texturedrawn + (first * pitch), (last - first) * pitch);
+	}
+}
+
 void WII_SetRenderCallback( void (*cb)(void) )
 {
   rendercallback = cb;
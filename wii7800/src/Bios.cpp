@@ -97,6 +97,7 @@ bool bios_IsLoaded( ) {
 // ----------------------------------------------------------------------------
 void bios_Release( ) {
   if(bios_data) {
+    memory_UnmapROM( );
     delete [ ] bios_data;
     bios_size = 0;
     bios_data = NULL;
@@ -108,6 +109,6 @@ void bios_Release( ) {
 // ----------------------------------------------------------------------------
 void bios_Store( ) {
   if(bios_data != NULL && bios_enabled) {
-    memory_WriteROM(65536 - bios_size, bios_size, bios_data);
+    memory_MapROM(65536 - bios_size, bios_size, bios_data);
   }
 }
@@ -22,8 +22,10 @@
 // ----------------------------------------------------------------------------
 // Maria.c
 // ----------------------------------------------------------------------------
+#include <string.h>
 #include "Maria.h"
 #define MARIA_LINERAM_SIZE 160
+#define MARIA_LINERAM_SPAN 256
 
 extern unsigned char* wii_sdl_get_blit_addr();
 extern unsigned int wii_lightgun_flash;
@@ -32,9 +34,17 @@ extern bool lightgun_enabled;
 rect maria_displayArea = {0, 16, 319, 258};
 rect maria_visibleArea = {0, 26, 319, 248};
 byte* maria_surface = 0;
+byte  maria_layout = MARIA_LAYOUT_LINEAR;
+// Whether the pixels of the frame are not written, the display lists are
+// still walked so the cycles and NMIs stay the same
+bool  maria_skipFrame = false;
 word  maria_scanline = 1;
 
-static byte maria_lineRAM[MARIA_LINERAM_SIZE];
+// Line RAM covers the whole range of the horizontal position so that the
+// cells of an object can be stored as a block, cells beyond the visible 160
+// land in the unused tail. Blocks are four cells wide, the ones that would
+// run past the end are stored a cell at a time.
+static byte maria_lineRAM[MARIA_LINERAM_SPAN];
 static uint maria_cycles;
 static pair maria_dpp;
 static pair maria_dp;
@@ -45,52 +55,138 @@ static signed char maria_offset;
 static byte maria_h08;
 static byte maria_h16;
 static byte maria_wmode;
+static byte maria_zone;
+
+// The layout of each surface row: blank rows are still cleared, narrow rows
+// hold 160 pixels (each standing for two), wide rows 320. Widened rows are
+// narrow rows expanded to 320 pixels for a frame that mixes in wide rows,
+// they still match the line they were written from.
+#define MARIA_ROW_BLANK 0
+#define MARIA_ROW_NARROW 1
+#define MARIA_ROW_WIDE 2
+#define MARIA_ROW_WIDENED 3
+
+static byte maria_rows[MARIA_SURFACE_ROWS];
+static uint maria_wideRows;
+static uint maria_widenedRows;
+
+// The palette resolved to the RGB565 surface
+static word maria_palette565[256];
+
+// What each row was last written from: the read mode, the palette entries
+// and the line RAM. A row written from the same ones again already holds its
+// pixels and is skipped. Rows that were written (or drawn over) since the
+// dirty rows were last cleared are flagged in the dirty bitmap.
+#define MARIA_LINE_BACKGROUND 4
+
+struct Line {
+  bool valid;
+  byte rmode;
+  byte colors[32];
+  byte cells[MARIA_LINERAM_SIZE];
+};
+
+static Line maria_lines[MARIA_SURFACE_ROWS];
+static uint maria_dirty[(MARIA_SURFACE_ROWS + 31) / 32];
+
+uint maria_cacheHits = 0;
+uint maria_cacheMisses = 0;
+uint maria_linesWritten = 0;
+uint maria_linesSkipped = 0;
 
 // ----------------------------------------------------------------------------
-// StoreCell
+// Display list cache
+// The parsed headers of the display list of each zone of the frame. A zone
+// is reused for every line (and every frame) until its display list pointer
+// changes or one of the pages its headers were read from is written.
 // ----------------------------------------------------------------------------
-static inline void maria_StoreCell(byte data) {
-  if(maria_horizontal < MARIA_LINERAM_SIZE) {
-    if(data) {
-      maria_lineRAM[maria_horizontal] = maria_palette | data;
-    }
-    else { 
-      byte kmode = memory_ram[CTRL] & 4;
-      if(kmode) {
-        maria_lineRAM[maria_horizontal] = 0;
-      }
-    }
-  }
-  maria_horizontal++;
+#define MARIA_CACHE_ZONES 256
+#define MARIA_CACHE_OBJECTS 64
+#define MARIA_CACHE_PAGES 4
+#define MARIA_OBJECT_EXTENDED 1
+#define MARIA_OBJECT_INDIRECT 2
+#define MARIA_OBJECT_WMODE 4
+
+struct Object {
+  pair pp;
+  byte palette;
+  byte horizontal;
+  byte width;
+  byte flags;
+};
+
+struct Zone {
+  bool valid;
+  word dp;
+  byte objects;
+  byte pages;
+  byte page[MARIA_CACHE_PAGES];
+  uint version[MARIA_CACHE_PAGES];
+  Object object[MARIA_CACHE_OBJECTS];
+};
+
+static Zone maria_zones[MARIA_CACHE_ZONES];
+
+// ----------------------------------------------------------------------------
+// Expansion
+// The cells a graphics byte expands into, without the palette, and a mask of
+// the cells that are not transparent. Both are in line RAM order, one byte
+// per cell.
+// ----------------------------------------------------------------------------
+struct Expansion {
+  uint cells;
+  uint opaque;
+};
+
+static Expansion maria_expand4[256];
+static Expansion maria_expand2[256];
+static uint maria_written4;
+static uint maria_written2;
+
+// ----------------------------------------------------------------------------
+// Pack
+// ----------------------------------------------------------------------------
+static inline uint maria_Pack(byte cell0, byte cell1, byte cell2, byte cell3) {
+  byte cells[4] = {cell0, cell1, cell2, cell3};
+  uint packed;
+  memcpy(&packed, cells, 4);
+  return packed;
 }
 
 // ----------------------------------------------------------------------------
-// StoreCell
+// BuildExpansion
+// Four 2-bit cells per byte normally, two 4-bit cells when write mode is set.
 // ----------------------------------------------------------------------------
-static inline void maria_StoreCell(byte high, byte low) {
-  if(maria_horizontal < MARIA_LINERAM_SIZE) {
-    if(low || high) {
-      maria_lineRAM[maria_horizontal] = maria_palette & 16 | high | low;
-    }
-    else { 
-      byte kmode = memory_ram[CTRL] & 4;
-      if(kmode) {
-        maria_lineRAM[maria_horizontal] = 0;
-      }
-    }
+static void maria_BuildExpansion( ) {
+  for(int data = 0; data < 256; data++) {
+    byte cells[4];
+    cells[0] = (data & 192) >> 6;
+    cells[1] = (data & 48) >> 4;
+    cells[2] = (data & 12) >> 2;
+    cells[3] = data & 3;
+    maria_expand4[data].cells = maria_Pack(cells[0], cells[1], cells[2], cells[3]);
+    maria_expand4[data].opaque = maria_Pack(cells[0]? 255: 0, cells[1]? 255: 0, cells[2]? 255: 0, cells[3]? 255: 0);
+
+    cells[0] = (data & 12) | ((data & 192) >> 6);
+    cells[1] = ((data & 48) >> 4) | ((data & 3) << 2);
+    maria_expand2[data].cells = maria_Pack(cells[0], cells[1], 0, 0);
+    maria_expand2[data].opaque = maria_Pack(cells[0]? 255: 0, cells[1]? 255: 0, 0, 0);
   }
-  maria_horizontal++;
+  maria_written4 = maria_Pack(255, 255, 255, 255);
+  maria_written2 = maria_Pack(255, 255, 0, 0);
 }
 
 // ----------------------------------------------------------------------------
 // IsHolyDMA
+// Only depends on the high byte of the graphics address, so it is checked
+// once per object and again only when a read crosses into the next page.
 // ----------------------------------------------------------------------------
-static inline bool maria_IsHolyDMA( ) {
-  if(maria_pp.w > 32767) {
-    if(maria_h16 && (maria_pp.w & 4096)) {
+static inline bool maria_IsHolyDMA(byte high) {
+  if(high & 128) {
+    if(maria_h16 && (high & 16)) {
       return true;
     }
-    if(maria_h08 && (maria_pp.w & 2048)) {
+    if(maria_h08 && (high & 8)) {
       return true;
     }
   }
@@ -100,98 +196,469 @@ static inline bool maria_IsHolyDMA( ) {
 // ----------------------------------------------------------------------------
 // GetColor
 // ----------------------------------------------------------------------------
-extern byte atari_pal8[256];
-
 static inline byte maria_GetColor(byte data) {  
   if(data & 3) {
-      return atari_pal8[memory_ram[BACKGRND + data]];
+      return memory_ram[BACKGRND + data];
   }
   else {
-      return atari_pal8[memory_ram[BACKGRND]];
+      return memory_ram[BACKGRND];
   }
 }
 
 // ----------------------------------------------------------------------------
-// StoreGraphic
+// StoreCells
+// Opaque cells take the palette, transparent cells are cleared in kangaroo
+// mode and left alone otherwise. Write mode stores two cells, four otherwise.
 // ----------------------------------------------------------------------------
-static inline void maria_StoreGraphic( ) {
-  byte data = memory_ram[maria_pp.w];
-  if(maria_wmode) {
-    if(maria_IsHolyDMA( )) {
-      maria_StoreCell(0, 0);
-      maria_StoreCell(0, 0);
-    }
-    else {
-      maria_StoreCell((data & 12), (data & 192) >> 6);
-      maria_StoreCell((data & 48) >> 4, (data & 3) << 2);
+template<bool wmode, bool kangaroo>
+static inline void maria_StoreCells(const Expansion& expansion, uint color) {
+  const byte count = wmode? 2: 4;
+  uint written = 0;
+  if(kangaroo) {
+    written = wmode? maria_written2: maria_written4;
+  }
+  if(maria_horizontal <= MARIA_LINERAM_SPAN - 4) {
+    byte* cell = maria_lineRAM + maria_horizontal;
+    uint line;
+    memcpy(&line, cell, 4);
+    line = (line & ~(expansion.opaque | written)) | ((expansion.cells | color) & expansion.opaque);
+    memcpy(cell, &line, 4);
+    maria_horizontal += count;
+  }
+  else {
+    byte cells[4];
+    byte opaque[4];
+    byte writes[4];
+    uint line = (expansion.cells | color) & expansion.opaque;
+    memcpy(cells, &line, 4);
+    memcpy(opaque, &expansion.opaque, 4);
+    memcpy(writes, &written, 4);
+    for(byte index = 0; index < count; index++) {
+      if(maria_horizontal < MARIA_LINERAM_SIZE && (opaque[index] || writes[index])) {
+        maria_lineRAM[maria_horizontal] = cells[index];
+      }
+      maria_horizontal++;
     }
   }
+}
+
+// ----------------------------------------------------------------------------
+// StoreGraphic
+// ----------------------------------------------------------------------------
+template<bool wmode, bool kangaroo>
+static inline void maria_StoreGraphic(bool holey, uint color) {
+  byte data = holey? 0: memory_Peek(maria_pp.w);
+  if(wmode) {
+    maria_StoreCells<wmode, kangaroo>(maria_expand2[data], color);
+  }
   else {
-    if(maria_IsHolyDMA( )) {
-      maria_StoreCell(0);
-      maria_StoreCell(0);
-      maria_StoreCell(0);
-      maria_StoreCell(0);
+    maria_StoreCells<wmode, kangaroo>(maria_expand4[data], color);
+  }
+  maria_pp.w++;
+}
+
+// ----------------------------------------------------------------------------
+// SetRow
+// ----------------------------------------------------------------------------
+static inline void maria_SetRow(uint row, byte format) {
+  if(maria_rows[row] == MARIA_ROW_WIDE) {
+    maria_wideRows--;
+  }
+  else if(maria_rows[row] == MARIA_ROW_WIDENED) {
+    maria_widenedRows--;
+  }
+  if(format == MARIA_ROW_WIDE) {
+    maria_wideRows++;
+  }
+  else if(format == MARIA_ROW_WIDENED) {
+    maria_widenedRows++;
+  }
+  maria_rows[row] = format;
+}
+
+// ----------------------------------------------------------------------------
+// SetDirty
+// ----------------------------------------------------------------------------
+static inline void maria_SetDirty(uint row) {
+  maria_dirty[row >> 5] |= 1 << (row & 31);
+}
+
+// ----------------------------------------------------------------------------
+// UpdateLine
+// Records what the row is about to be written from, returns false if the row
+// already holds those pixels. A widened row still holds the narrow pixels.
+// ----------------------------------------------------------------------------
+static inline bool maria_UpdateLine(uint row, byte rmode, byte format, const byte* colors) {
+  Line& line = maria_lines[row];
+  uint cells = (rmode == MARIA_LINE_BACKGROUND)? 0: MARIA_LINERAM_SIZE;
+  byte current = maria_rows[row];
+  if(current == MARIA_ROW_WIDENED) {
+    current = MARIA_ROW_NARROW;
+  }
+  if(line.valid && current == format && line.rmode == rmode &&
+      !memcmp(line.colors, colors, sizeof(line.colors)) &&
+      !memcmp(line.cells, maria_lineRAM, cells)) {
+    maria_linesSkipped++;
+    return false;
+  }
+  line.valid = true;
+  line.rmode = rmode;
+  memcpy(line.colors, colors, sizeof(line.colors));
+  memcpy(line.cells, maria_lineRAM, cells);
+  maria_SetDirty(row);
+  maria_linesWritten++;
+  return true;
+}
+
+// ----------------------------------------------------------------------------
+// BuildIndexes
+// Reads the palette entry of every line RAM value. Line RAM values never
+// exceed 31, so the whole scanline is converted from this table without
+// touching the palette registers again.
+// ----------------------------------------------------------------------------
+static inline void maria_BuildIndexes(byte* indexes) {
+  for(int index = 0; index < 32; index++) {
+    indexes[index] = maria_GetColor(index);
+  }
+}
+
+// ----------------------------------------------------------------------------
+// BuildColors
+// Resolves every line RAM value to its output pixel.
+// ----------------------------------------------------------------------------
+static inline void maria_BuildColors(word* color, const byte* indexes) {
+  for(int index = 0; index < 32; index++) {
+    color[index] = maria_palette565[indexes[index]];
+  }
+}
+
+// ----------------------------------------------------------------------------
+// BuildPixels
+// Resolves every line RAM value to the pair of output pixels it produces in
+// the 320 pixel read modes.
+// ----------------------------------------------------------------------------
+static inline void maria_BuildPixels(byte rmode, word (*pixels)[2], const byte* indexes) {
+  word color[32];
+  maria_BuildColors(color, indexes);
+  for(int index = 0; index < 32; index++) {
+    if(rmode == 2) {
+      pixels[index][0] = color[(index & 16) | ((index & 8) >> 3) | (index & 2)];
+      pixels[index][1] = color[(index & 16) | ((index & 4) >> 2) | ((index & 1) << 1)];
     }
     else {
-      maria_StoreCell((data & 192) >> 6);
-      maria_StoreCell((data & 48) >> 4);
-      maria_StoreCell((data & 12) >> 2);
-      maria_StoreCell(data & 3);
+      pixels[index][0] = color[index & 30];
+      pixels[index][1] = color[(index & 28) | ((index & 1) << 1)];
     }
   }
-  maria_pp.w++;
+}
+
+// ----------------------------------------------------------------------------
+// GetOffset
+// The offset of a pixel in the surface. The tiled layout is the one of a GX
+// texture MARIA_SURFACE_WIDTH pixels wide: 4x4 tiles of pixels, a row of
+// tiles after the other.
+// ----------------------------------------------------------------------------
+static inline uint maria_GetOffset(uint x, uint row) {
+  if(maria_layout == MARIA_LAYOUT_TILED) {
+    return ((row >> 2) * (MARIA_SURFACE_WIDTH << 2)) + ((x >> 2) << 4) + ((row & 3) << 2) + (x & 3);
+  }
+  return (row * MARIA_SURFACE_WIDTH) + x;
+}
+
+// ----------------------------------------------------------------------------
+// GetStride
+// The distance between the groups of four pixels of a row.
+// ----------------------------------------------------------------------------
+static inline uint maria_GetStride( ) {
+  return (maria_layout == MARIA_LAYOUT_TILED)? 16: 4;
+}
+
+// ----------------------------------------------------------------------------
+// GetRow
+// ----------------------------------------------------------------------------
+static inline word* maria_GetRow(uint row) {
+  return (word*)maria_surface + maria_GetOffset(0, row);
 }
 
 // ----------------------------------------------------------------------------
 // WriteLineRAM
+// Read mode 0 (160A/160B) is written as a narrow row of 160 pixels, the 320
+// pixel read modes as a wide row. Rows are written a group of four pixels at
+// a time, which are contiguous in either layout.
 // ----------------------------------------------------------------------------
-static inline void maria_WriteLineRAM(byte* buffer) {
-  byte rmode = memory_ram[CTRL] & 3;
+static inline void maria_WriteLineRAM(uint row, byte rmode, const byte* indexes) {
+  word* buffer = maria_GetRow(row);
+  uint stride = maria_GetStride( );
   if(rmode == 0) {
-    int pixel = 0;
+    word color[32];
+    maria_BuildColors(color, indexes);
     for(int index = 0; index < MARIA_LINERAM_SIZE; index += 4) {
-      word color;
-      color = maria_GetColor(maria_lineRAM[index + 0]);
-      buffer[pixel++] = color;
-      buffer[pixel++] = color;
-      color = maria_GetColor(maria_lineRAM[index + 1]);
-      buffer[pixel++] = color;
-      buffer[pixel++] = color;
-      color = maria_GetColor(maria_lineRAM[index + 2]);
-      buffer[pixel++] = color;
-      buffer[pixel++] = color;
-      color = maria_GetColor(maria_lineRAM[index + 3]);
-      buffer[pixel++] = color;
-      buffer[pixel++] = color;
+      buffer[0] = color[maria_lineRAM[index + 0]];
+      buffer[1] = color[maria_lineRAM[index + 1]];
+      buffer[2] = color[maria_lineRAM[index + 2]];
+      buffer[3] = color[maria_lineRAM[index + 3]];
+      buffer += stride;
     }
+    maria_SetRow(row, MARIA_ROW_NARROW);
+    return;
   }
-  else if(rmode == 2) { 
-    int pixel = 0;
-    for(int index = 0; index < MARIA_LINERAM_SIZE; index += 4) {
-      buffer[pixel++] = maria_GetColor((maria_lineRAM[index + 0] & 16) | ((maria_lineRAM[index + 0] & 8) >> 3) | ((maria_lineRAM[index + 0] & 2)));
-      buffer[pixel++] = maria_GetColor((maria_lineRAM[index + 0] & 16) | ((maria_lineRAM[index + 0] & 4) >> 2) | ((maria_lineRAM[index + 0] & 1) << 1));
-      buffer[pixel++] = maria_GetColor((maria_lineRAM[index + 1] & 16) | ((maria_lineRAM[index + 1] & 8) >> 3) | ((maria_lineRAM[index + 1] & 2)));
-      buffer[pixel++] = maria_GetColor((maria_lineRAM[index + 1] & 16) | ((maria_lineRAM[index + 1] & 4) >> 2) | ((maria_lineRAM[index + 1] & 1) << 1));
-      buffer[pixel++] = maria_GetColor((maria_lineRAM[index + 2] & 16) | ((maria_lineRAM[index + 2] & 8) >> 3) | ((maria_lineRAM[index + 2] & 2)));
-      buffer[pixel++] = maria_GetColor((maria_lineRAM[index + 2] & 16) | ((maria_lineRAM[index + 2] & 4) >> 2) | ((maria_lineRAM[index + 2] & 1) << 1));
-      buffer[pixel++] = maria_GetColor((maria_lineRAM[index + 3] & 16) | ((maria_lineRAM[index + 3] & 8) >> 3) | ((maria_lineRAM[index + 3] & 2)));
-      buffer[pixel++] = maria_GetColor((maria_lineRAM[index + 3] & 16) | ((maria_lineRAM[index + 3] & 4) >> 2) | ((maria_lineRAM[index + 3] & 1) << 1));
+  word pixels[32][2];
+  maria_BuildPixels(rmode, pixels, indexes);
+  for(int index = 0; index < MARIA_LINERAM_SIZE; index += 2) {
+    const word* left = pixels[maria_lineRAM[index + 0]];
+    const word* right = pixels[maria_lineRAM[index + 1]];
+    buffer[0] = left[0];
+    buffer[1] = left[1];
+    buffer[2] = right[0];
+    buffer[3] = right[1];
+    buffer += stride;
+  }
+  maria_SetRow(row, MARIA_ROW_WIDE);
+}
+
+static inline void maria_WriteLineRAM(uint row) {
+  byte rmode = memory_ram[CTRL] & 3;
+  if(rmode == 1 || row >= MARIA_SURFACE_ROWS) {
+    return;
+  }
+  byte indexes[32];
+  maria_BuildIndexes(indexes);
+  if(!maria_UpdateLine(row, rmode, (rmode == 0)? MARIA_ROW_NARROW: MARIA_ROW_WIDE, indexes)) {
+    return;
+  }
+  maria_WriteLineRAM(row, rmode, indexes);
+}
+
+// ----------------------------------------------------------------------------
+// FillBackground
+// ----------------------------------------------------------------------------
+static inline void maria_FillBackground(uint row, byte index) {
+  word color = maria_palette565[index];
+  word* buffer = maria_GetRow(row);
+  uint stride = maria_GetStride( );
+  for(uint index = 0; index < MARIA_LINERAM_SIZE; index += 4) {
+    buffer[0] = buffer[1] = buffer[2] = buffer[3] = color;
+    buffer += stride;
+  }
+  maria_SetRow(row, MARIA_ROW_NARROW);
+}
+
+static inline void maria_FillBackground(uint row) {
+  if(row >= MARIA_SURFACE_ROWS) {
+    return;
+  }
+  byte indexes[32];
+  memset(indexes, maria_GetColor(0), sizeof(indexes));
+  if(!maria_UpdateLine(row, MARIA_LINE_BACKGROUND, MARIA_ROW_NARROW, indexes)) {
+    return;
+  }
+  maria_FillBackground(row, indexes[0]);
+}
+
+// ----------------------------------------------------------------------------
+// WidenRows
+// Only narrow rows are widened, blank rows are the same at either width and
+// stay blank. Rows widened for an earlier frame are already wide.
+// ----------------------------------------------------------------------------
+static inline void maria_WidenRows( ) {
+  for(uint row = 0; row < MARIA_SURFACE_ROWS; row++) {
+    if(maria_rows[row] == MARIA_ROW_NARROW) {
+      maria_SetDirty(row);
+      word* buffer = (word*)maria_surface;
+      for(int index = MARIA_LINERAM_SIZE - 1; index >= 0; index--) {
+        word pixel = buffer[maria_GetOffset(index, row)];
+        buffer[maria_GetOffset((index << 1) + 1, row)] = pixel;
+        buffer[maria_GetOffset(index << 1, row)] = pixel;
+      }
+      maria_SetRow(row, MARIA_ROW_WIDENED);
     }
   }
-  else if(rmode == 3) {
-    int pixel = 0;
-    for(int index = 0; index < MARIA_LINERAM_SIZE; index += 4) {
-      buffer[pixel++] = maria_GetColor((maria_lineRAM[index + 0] & 30));
-      buffer[pixel++] = maria_GetColor((maria_lineRAM[index + 0] & 28) | ((maria_lineRAM[index + 0] & 1) << 1));
-      buffer[pixel++] = maria_GetColor((maria_lineRAM[index + 1] & 30));
-      buffer[pixel++] = maria_GetColor((maria_lineRAM[index + 1] & 28) | ((maria_lineRAM[index + 1] & 1) << 1));
-      buffer[pixel++] = maria_GetColor((maria_lineRAM[index + 2] & 30));
-      buffer[pixel++] = maria_GetColor((maria_lineRAM[index + 2] & 28) | ((maria_lineRAM[index + 2] & 1) << 1));
-      buffer[pixel++] = maria_GetColor((maria_lineRAM[index + 3] & 30));
-      buffer[pixel++] = maria_GetColor((maria_lineRAM[index + 3] & 28) | ((maria_lineRAM[index + 3] & 1) << 1));
+}
+
+// ----------------------------------------------------------------------------
+// NarrowRows
+// Takes the widened rows back to 160 pixels once no row is written wide.
+// ----------------------------------------------------------------------------
+static inline void maria_NarrowRows( ) {
+  for(uint row = 0; row < MARIA_SURFACE_ROWS; row++) {
+    if(maria_rows[row] == MARIA_ROW_WIDENED) {
+      maria_SetDirty(row);
+      word* buffer = (word*)maria_surface;
+      for(uint index = 0; index < MARIA_LINERAM_SIZE; index++) {
+        buffer[maria_GetOffset(index, row)] = buffer[maria_GetOffset(index << 1, row)];
+      }
+      maria_SetRow(row, MARIA_ROW_NARROW);
+    }
+  }
+}
+
+// ----------------------------------------------------------------------------
+// ReadHeader
+// Parses the display list header at the display list pointer, returns false
+// at the end of the list.
+// ----------------------------------------------------------------------------
+static inline bool maria_ReadHeader(Object& object) {
+  byte mode = memory_Peek(maria_dp.w + 1);
+  if(!(mode & 0x5f)) {
+    return false;
+  }
+  object.pp.b.l = memory_Peek(maria_dp.w);
+  object.pp.b.h = memory_Peek(maria_dp.w + 2);
+
+  if(mode & 31) { 
+    object.flags = 0;
+    object.palette = (memory_Peek(maria_dp.w + 1) & 224) >> 3;
+    object.horizontal = memory_Peek(maria_dp.w + 3);
+    byte width = memory_Peek(maria_dp.w + 1) & 31;
+    object.width = ((~width) & 31) + 1;
+    maria_dp.w += 4;
+  }
+  else { 
+    object.flags = MARIA_OBJECT_EXTENDED;
+    if(memory_Peek(maria_dp.w + 1) & 32) {
+      object.flags |= MARIA_OBJECT_INDIRECT;
+    }
+    if(memory_Peek(maria_dp.w + 1) & 128) {
+      object.flags |= MARIA_OBJECT_WMODE;
+    }
+    object.palette = (memory_Peek(maria_dp.w + 3) & 224) >> 3;
+    object.horizontal = memory_Peek(maria_dp.w + 4);
+    byte width = memory_Peek(maria_dp.w + 3) & 31;
+    object.width = (width == 0)? 32: ((~width) & 31) + 1;
+    maria_dp.w += 5;
+  }
+  return true;
+}
+
+// ----------------------------------------------------------------------------
+// RenderObject
+// The graphics reads of one object, specialized for each combination of
+// write mode, kangaroo mode, character width and indirect mode.
+// ----------------------------------------------------------------------------
+template<bool wmode, bool kangaroo, bool cwidth, bool indirect>
+static void maria_RenderObject(byte width) {
+  uint color = (wmode? (maria_palette & 16): maria_palette) * 0x01010101;
+  if(!indirect) {
+    maria_pp.b.h += maria_offset;
+    bool holey = maria_IsHolyDMA(maria_pp.b.h);
+    for(byte index = 0; index < width; index++) {
+      maria_cycles += 3; // Maria cycles (Direct graphic read)
+      maria_StoreGraphic<wmode, kangaroo>(holey, color);
+      if(!maria_pp.b.l) {
+        holey = maria_IsHolyDMA(maria_pp.b.h);
+      }
+    }
+  }
+  else {
+    pair basePP = maria_pp;
+    byte high = memory_ram[CHARBASE] + maria_offset;
+    bool holey = maria_IsHolyDMA(high);
+    bool holeyNext = maria_IsHolyDMA(high + 1);
+    for(byte index = 0; index < width; index++) {
+      maria_cycles += 3; // Maria cycles (Indirect)
+      maria_pp.b.l = memory_Peek(basePP.w++);
+      maria_pp.b.h = high;
+      maria_cycles += 3; // Maria cycles (Indirect, 1 byte)
+      maria_StoreGraphic<wmode, kangaroo>(holey, color);
+      if(cwidth) {
+        maria_cycles += 3; // Maria cycles (Indirect, 2 bytes)
+        maria_StoreGraphic<wmode, kangaroo>(maria_pp.b.l? holey: holeyNext, color);
+      }
+    }
+  }
+}
+
+// Indexed by write mode (8), kangaroo mode (4), character width (2) and
+// indirect mode (1)
+typedef void (*ObjectRenderer)(byte width);
+
+static const ObjectRenderer MARIA_RENDERERS[16] = {
+  maria_RenderObject<false, false, false, false>,
+  maria_RenderObject<false, false, false, true>,
+  maria_RenderObject<false, false, true, false>,
+  maria_RenderObject<false, false, true, true>,
+  maria_RenderObject<false, true, false, false>,
+  maria_RenderObject<false, true, false, true>,
+  maria_RenderObject<false, true, true, false>,
+  maria_RenderObject<false, true, true, true>,
+  maria_RenderObject<true, false, false, false>,
+  maria_RenderObject<true, false, false, true>,
+  maria_RenderObject<true, false, true, false>,
+  maria_RenderObject<true, false, true, true>,
+  maria_RenderObject<true, true, false, false>,
+  maria_RenderObject<true, true, false, true>,
+  maria_RenderObject<true, true, true, false>,
+  maria_RenderObject<true, true, true, true>
+};
+
+// ----------------------------------------------------------------------------
+// StoreObject
+// ----------------------------------------------------------------------------
+static inline void maria_StoreObject(const Object& object, byte modes) {
+  maria_pp = object.pp;
+  maria_palette = object.palette;
+  maria_horizontal = object.horizontal;
+  if(object.flags & MARIA_OBJECT_EXTENDED) {
+    maria_cycles += 12; // Maria cycles (Header 5 byte)
+    maria_wmode = object.flags & MARIA_OBJECT_WMODE;
+  }
+  else {
+    maria_cycles += 8; // Maria cycles (Header 4 byte)
+  }
+
+  if(maria_wmode) {
+    modes |= 8;
+  }
+  if(object.flags & MARIA_OBJECT_INDIRECT) {
+    modes |= 1;
+  }
+  MARIA_RENDERERS[modes](object.width);
+}
+
+// ----------------------------------------------------------------------------
+// AddPages
+// Adds the pages holding the address range to the zone, returns false if
+// the zone cannot be cached. Pages 0 and 2 hold registers that are updated
+// without going through the write handler.
+// ----------------------------------------------------------------------------
+static bool maria_AddPages(Zone& zone, word address, byte size) {
+  for(byte index = 0; index < size; index++) {
+    byte page = (address + index) >> 8;
+    if(page == 0 || page == 2) {
+      return false;
+    }
+    bool found = false;
+    for(byte entry = 0; entry < zone.pages; entry++) {
+      if(zone.page[entry] == page) {
+        found = true;
+        break;
+      }
+    }
+    if(!found) {
+      if(zone.pages == MARIA_CACHE_PAGES) {
+        return false;
+      }
+      zone.page[zone.pages++] = page;
+    }
+  }
+  return true;
+}
+
+// ----------------------------------------------------------------------------
+// IsCached
+// Whether the zone holds the parsed display list at the display list
+// pointer, with none of its pages written or remapped since.
+// ----------------------------------------------------------------------------
+static inline bool maria_IsCached(const Zone& zone) {
+  if(!zone.valid || zone.dp != maria_dp.w) {
+    return false;
+  }
+  for(byte entry = 0; entry < zone.pages; entry++) {
+    if(memory_pageVersion[zone.page[entry]] != zone.version[entry]) {
+      return false;
     }
   }
+  return true;
 }
 
 // ----------------------------------------------------------------------------
@@ -201,57 +668,53 @@ static inline void maria_StoreLineRAM( ) {
   for(int index = 0; index < MARIA_LINERAM_SIZE; index++) {
     maria_lineRAM[index] = 0;
   }
-  
-  byte mode = memory_ram[maria_dp.w + 1];
-  while(mode & 0x5f) {
-    byte width;
-    byte indirect = 0;
- 
-    maria_pp.b.l = memory_ram[maria_dp.w];
-    maria_pp.b.h = memory_ram[maria_dp.w + 2];
-    
-    if(mode & 31) { 
-      maria_cycles += 8; // Maria cycles (Header 4 byte)
-      maria_palette = (memory_ram[maria_dp.w + 1] & 224) >> 3;
-      maria_horizontal = memory_ram[maria_dp.w + 3];
-      width = memory_ram[maria_dp.w + 1] & 31;
-      width = ((~width) & 31) + 1;
-      maria_dp.w += 4;
-    }
-    else { 
-      maria_cycles += 12; // Maria cycles (Header 5 byte)
-      maria_palette = (memory_ram[maria_dp.w + 3] & 224) >> 3;
-      maria_horizontal = memory_ram[maria_dp.w + 4];
-      indirect = memory_ram[maria_dp.w + 1] & 32;
-      maria_wmode = memory_ram[maria_dp.w + 1] & 128;
-      width = memory_ram[maria_dp.w + 3] & 31;
-      width = (width == 0)? 32: ((~width) & 31) + 1;
-      maria_dp.w += 5;
+
+  // Kangaroo mode (4) and character width (2) of the renderer index
+  byte modes = ((memory_ram[CTRL] & 4)? 4: 0) | ((memory_ram[CTRL] & 16)? 2: 0);
+  Zone& zone = maria_zones[maria_zone];
+  if(maria_IsCached(zone)) {
+    maria_cacheHits++;
+    for(byte index = 0; index < zone.objects; index++) {
+      maria_StoreObject(zone.object[index], modes);
     }
+    return;
+  }
 
-    if(!indirect) {
-      maria_pp.b.h += maria_offset;
-      for(int index = 0; index < width; index++) {
-        maria_cycles += 3; // Maria cycles (Direct graphic read)
-        maria_StoreGraphic( );
+  maria_cacheMisses++;
+  zone.valid = false;
+  zone.dp = maria_dp.w;
+  zone.objects = 0;
+  zone.pages = 0;
+  bool cacheable = true;
+  Object object;
+  word header = maria_dp.w;
+  while(maria_ReadHeader(object)) {
+    if(cacheable) {
+      cacheable = maria_AddPages(zone, header, maria_dp.w - header) && 
+        zone.objects < MARIA_CACHE_OBJECTS;
+      if(cacheable) {
+        zone.object[zone.objects++] = object;
       }
     }
-    else {
-      byte cwidth = memory_ram[CTRL] & 16;
-      pair basePP = maria_pp;
-      for(int index = 0; index < width; index++) {
-        maria_cycles += 3; // Maria cycles (Indirect)
-        maria_pp.b.l = memory_ram[basePP.w++];
-        maria_pp.b.h = memory_ram[CHARBASE] + maria_offset;        
-        maria_cycles += 3; // Maria cycles (Indirect, 1 byte)
-        maria_StoreGraphic( );
-        if(cwidth) {
-          maria_cycles += 3; // Maria cycles (Indirect, 2 bytes)
-          maria_StoreGraphic( );
-        }
-      }
+    maria_StoreObject(object, modes);
+    header = maria_dp.w;
+  }
+
+  if(cacheable && maria_AddPages(zone, header + 1, 1)) {
+    for(byte entry = 0; entry < zone.pages; entry++) {
+      memory_Watch(zone.page[entry]);
+      zone.version[entry] = memory_pageVersion[zone.page[entry]];
     }
-    mode = memory_ram[maria_dp.w + 1];
+    zone.valid = true;
+  }
+}
+
+// ----------------------------------------------------------------------------
+// FlushCache
+// ----------------------------------------------------------------------------
+void maria_FlushCache( ) {
+  for(uint index = 0; index < MARIA_CACHE_ZONES; index++) {
+    maria_zones[index].valid = false;
   }
 }
 
@@ -259,11 +722,9 @@ static inline void maria_StoreLineRAM( ) {
 // Reset
 // ----------------------------------------------------------------------------
 void maria_Reset( ) {
-  if (! maria_surface) maria_surface = wii_sdl_get_blit_addr();
+  maria_BuildExpansion( );
   maria_scanline = 1;
-  for(int index = 0; index < MARIA_SURFACE_SIZE; index++) {
-    maria_surface[index] = 0;
-  }
+  maria_Clear( );
 
  //
  // WII
@@ -281,6 +742,10 @@ void maria_Reset( ) {
  maria_h08 = 0;
  maria_h16 = 0;
  maria_wmode = 0;
+ maria_zone = 0;
+ maria_linesWritten = 0;
+ maria_linesSkipped = 0;
+ maria_FlushCache( );
 }
 
 // ----------------------------------------------------------------------------
@@ -293,15 +758,11 @@ uint maria_RenderScanline( ) {
   // Displays the background color when Maria is disabled (if applicable)
   //
   if( ( ( memory_ram[CTRL] & 96 ) != 64 ) &&
+      !maria_skipFrame &&
       maria_scanline >= maria_visibleArea.top && 
       maria_scanline <= maria_visibleArea.bottom &&
       ( !lightgun_enabled || wii_lightgun_flash ) ) {
-      byte bgcolor = maria_GetColor(0);
-      byte *bgstart = maria_surface + ((maria_scanline - maria_displayArea.top) * maria_displayArea.GetLength());      
-      for(uint index = 0; index < MARIA_LINERAM_SIZE; index++ ) {
-        *bgstart++ = bgcolor;
-        *bgstart++ = bgcolor;
-      }
+      maria_FillBackground(maria_scanline - maria_displayArea.top);
   }
 
   if((memory_ram[CTRL] & 96) == 64 && maria_scanline >= maria_displayArea.top && maria_scanline <= maria_displayArea.bottom) {
@@ -310,31 +771,33 @@ uint maria_RenderScanline( ) {
       maria_cycles += 10; // Maria cycles (End of VBLANK)
       maria_dpp.b.l = memory_ram[DPPL];
       maria_dpp.b.h = memory_ram[DPPH];
-      maria_h08 = memory_ram[maria_dpp.w] & 32;
-      maria_h16 = memory_ram[maria_dpp.w] & 64;
-      maria_offset = memory_ram[maria_dpp.w] & 15;
-      maria_dp.b.l = memory_ram[maria_dpp.w + 2];
-      maria_dp.b.h = memory_ram[maria_dpp.w + 1];
-      if(memory_ram[maria_dpp.w] & 128) {
+      maria_zone = 0;
+      maria_h08 = memory_Peek(maria_dpp.w) & 32;
+      maria_h16 = memory_Peek(maria_dpp.w) & 64;
+      maria_offset = memory_Peek(maria_dpp.w) & 15;
+      maria_dp.b.l = memory_Peek(maria_dpp.w + 2);
+      maria_dp.b.h = memory_Peek(maria_dpp.w + 1);
+      if(memory_Peek(maria_dpp.w) & 128) {
         maria_cycles += 20; // Maria cycles (NMI)  /*29, 16, 20*/
         sally_ExecuteNMI( );
       }
     }
-    else if(maria_scanline >= maria_visibleArea.top && maria_scanline <= maria_visibleArea.bottom) {
-      maria_WriteLineRAM(maria_surface + ((maria_scanline - maria_displayArea.top) * maria_displayArea.GetLength( )));
+    else if(!maria_skipFrame && maria_scanline >= maria_visibleArea.top && maria_scanline <= maria_visibleArea.bottom) {
+      maria_WriteLineRAM(maria_scanline - maria_displayArea.top);
     }
     if(maria_scanline != maria_displayArea.bottom) {
-      maria_dp.b.l = memory_ram[maria_dpp.w + 2];
-      maria_dp.b.h = memory_ram[maria_dpp.w + 1];
+      maria_dp.b.l = memory_Peek(maria_dpp.w + 2);
+      maria_dp.b.h = memory_Peek(maria_dpp.w + 1);
       maria_StoreLineRAM( );
       maria_offset--;
       if(maria_offset < 0) {        
         maria_cycles += 10; // Maria cycles (Last line of zone) ( /*20*/ 
         maria_dpp.w += 3;
-        maria_h08 = memory_ram[maria_dpp.w] & 32;
-        maria_h16 = memory_ram[maria_dpp.w] & 64;
-        maria_offset = memory_ram[maria_dpp.w] & 15;
-        if(memory_ram[maria_dpp.w] & 128) {
+        maria_zone++;
+        maria_h08 = memory_Peek(maria_dpp.w) & 32;
+        maria_h16 = memory_Peek(maria_dpp.w) & 64;
+        maria_offset = memory_Peek(maria_dpp.w) & 15;
+        if(memory_Peek(maria_dpp.w) & 128) {
           maria_cycles += 20; // Maria cycles (NMI) /*29, 16, 20*/
           sally_ExecuteNMI( );
         }
@@ -353,8 +816,105 @@ uint maria_RenderScanline( ) {
 // ----------------------------------------------------------------------------
 void maria_Clear( ) {
   if (! maria_surface) maria_surface = wii_sdl_get_blit_addr();
-  for(int index = 0; index < MARIA_SURFACE_SIZE; index++) {
-    maria_surface[index] = 0;
+  uint rows = MARIA_SURFACE_ROWS;
+  if(maria_layout == MARIA_LAYOUT_TILED) {
+    rows = (rows + 3) & ~3; // The last row of tiles
+  }
+  memset(maria_surface, 0, rows * MARIA_SURFACE_WIDTH * sizeof(word));
+  for(int index = 0; index < MARIA_SURFACE_ROWS; index++) {
+    maria_rows[index] = MARIA_ROW_BLANK;
+  }
+  maria_wideRows = 0;
+  maria_widenedRows = 0;
+  maria_Touch(0, MARIA_SURFACE_ROWS);
+}
+
+// ----------------------------------------------------------------------------
+// IsNarrow
+// Whether every row of the surface is narrow (or blank), in which case only
+// the left 160 pixels of each row are valid and stand for two pixels each.
+// ----------------------------------------------------------------------------
+bool maria_IsNarrow( ) {
+  return maria_wideRows == 0 && maria_widenedRows == 0;
+}
+
+// ----------------------------------------------------------------------------
+// Widen
+// Expands the narrow rows to the full 320 pixels, before drawing over the
+// whole surface.
+// ----------------------------------------------------------------------------
+void maria_Widen( ) {
+  maria_WidenRows( );
+}
+
+// ----------------------------------------------------------------------------
+// Fit
+// Brings the rows of a finished frame to one width: the narrow rows are
+// widened if any row was written wide, otherwise the widened rows are
+// narrowed again. Only rows that were written narrow since, or that change
+// width, are rewritten (and dirty).
+// ----------------------------------------------------------------------------
+void maria_Fit( ) {
+  if(maria_wideRows != 0) {
+    maria_WidenRows( );
+  }
+  else if(maria_widenedRows != 0) {
+    maria_NarrowRows( );
+  }
+}
+
+// ----------------------------------------------------------------------------
+// SetPalette
+// Resolves the 256 color palette (RGB triplets) to RGB565.
+// ----------------------------------------------------------------------------
+void maria_SetPalette(const byte* palette) {
+  for(uint index = 0; index < 256; index++) {
+    uint r = palette[(index * 3) + 0];
+    uint g = palette[(index * 3) + 1];
+    uint b = palette[(index * 3) + 2];
+    maria_palette565[index] = ((r >> 3) << 11) | ((g >> 2) << 5) | (b >> 3);
+  }
+  maria_Touch(0, MARIA_SURFACE_ROWS);
+}
+
+// ----------------------------------------------------------------------------
+// GetPixel
+// The address of a pixel of the (RGB565) surface.
+// ----------------------------------------------------------------------------
+byte* maria_GetPixel(uint x, uint row) {
+  return (byte*)((word*)maria_surface + maria_GetOffset(x, row));
+}
+
+
+// ----------------------------------------------------------------------------
+// Touch
+// Flags rows that were drawn over outside of Maria, or whose pixels no
+// longer match what they were written from. They are dirty and are written
+// again in full.
+// ----------------------------------------------------------------------------
+void maria_Touch(uint row, uint count) {
+  for(uint index = row; index < row + count && index < MARIA_SURFACE_ROWS; index++) {
+    maria_lines[index].valid = false;
+    maria_SetDirty(index);
+  }
+}
+
+// ----------------------------------------------------------------------------
+// IsDirty
+// Whether any of the rows was written since the dirty rows were cleared.
+// ----------------------------------------------------------------------------
+bool maria_IsDirty(uint row, uint count) {
+  for(uint index = row; index < row + count && index < MARIA_SURFACE_ROWS; index++) {
+    if(maria_dirty[index >> 5] & (1 << (index & 31))) {
+      return true;
+    }
   }
+  return false;
 }
 
+// ----------------------------------------------------------------------------
+// ClearDirty
+// ----------------------------------------------------------------------------
+void maria_ClearDirty( ) {
+  memset(maria_dirty, 0, sizeof(maria_dirty));
+}
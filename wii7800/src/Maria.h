@@ -29,6 +29,11 @@
 # else
 #define MARIA_SURFACE_SIZE 77440
 # endif
+#define MARIA_SURFACE_WIDTH 320
+// The rows of the texture Maria writes to, enough for the PAL display area
+#define MARIA_SURFACE_ROWS 300
+#define MARIA_LAYOUT_LINEAR 0
+#define MARIA_LAYOUT_TILED 1
 
 #include "Equates.h"
 #include "Pair.h"
@@ -43,10 +48,25 @@ typedef unsigned int uint;
 extern void maria_Reset( );
 extern uint maria_RenderScanline( );
 extern void maria_Clear( );
+extern void maria_FlushCache( );
+extern bool maria_IsNarrow( );
+extern void maria_Widen( );
+extern void maria_Fit( );
+extern void maria_SetPalette(const byte* palette);
+extern byte* maria_GetPixel(uint x, uint row);
+extern void maria_Touch(uint row, uint count);
+extern bool maria_IsDirty(uint row, uint count);
+extern void maria_ClearDirty( );
 extern rect maria_displayArea;
 extern rect maria_visibleArea;
 //extern word* maria_surface;
 extern byte* maria_surface;
+extern byte maria_layout;
+extern bool maria_skipFrame;
 extern word maria_scanline;
+extern uint maria_cacheHits;
+extern uint maria_cacheMisses;
+extern uint maria_linesWritten;
+extern uint maria_linesSkipped;
 
 #endif
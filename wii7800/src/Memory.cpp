@@ -23,19 +23,120 @@
 // Memory.cpp
 // ----------------------------------------------------------------------------
 
+#include <string.h>
 #include "wii_main.h"
 #include "Memory.h"
 
 byte memory_ram[MEMORY_SIZE] = {0};
 byte memory_rom[MEMORY_SIZE] = {0};
+byte* memory_page[MEMORY_PAGES] = {0};
+byte* memory_readMap[MEMORY_PAGES] = {0};
+byte* memory_writeMap[MEMORY_PAGES] = {0};
+
+// Whether every byte of the page is flagged as ROM
+static bool memory_romPage[MEMORY_PAGES] = {0};
+// Incremented whenever the contents of the page may have changed: a write
+// through the slow handler or a remap. Only exact for watched pages, plain
+// RAM pages are written directly otherwise.
+uint memory_pageVersion[MEMORY_PAGES] = {0};
+// Plain RAM pages whose next write is routed through the slow handler
+static bool memory_watched[MEMORY_PAGES] = {0};
 
 int hs_sram_write_count = 0; // Debug, number of writes to High Score SRAM
 
+// ----------------------------------------------------------------------------
+// IsRegisterPage
+// Pages holding the TIA/Maria/RIOT registers, the mirrored RAM ranges and the
+// high score SRAM (write counter) must take the slow write handler.
+// ----------------------------------------------------------------------------
+static bool memory_IsRegisterPage(uint page) {
+  return page <= 0x02 || (page >= 0x10 && page <= 0x17) ||
+    page == 0x20 || page == 0x21;
+}
+
+// ----------------------------------------------------------------------------
+// MapPages
+// Rebuilds the page table entries covering the specified range.
+// ----------------------------------------------------------------------------
+static void memory_MapPages(uint address, uint size) {
+  if(size == 0) {
+    return;
+  }
+  uint last = (address + size - 1) >> 8;
+  for(uint page = address >> 8; page <= last; page++) {
+    byte* data = memory_ram + (page << 8);
+    if(memory_page[page] == NULL) {
+      memory_page[page] = data;
+    }
+    memory_readMap[page] = memory_page[page];
+    if(page == 0x02 || (cartridge_pokey && page == (POKEY_RANDOM >> 8))) {
+      memory_readMap[page] = NULL;
+    }
+
+    memory_pageVersion[page]++;
+    memory_writeMap[page] = data;
+    if(memory_IsRegisterPage(page) || memory_romPage[page] || memory_watched[page]) {
+      memory_writeMap[page] = NULL;
+    }
+    else {
+      for(uint index = 0; index < MEMORY_PAGE_SIZE; index++) {
+        if(memory_rom[(page << 8) + index]) {
+          memory_writeMap[page] = NULL;
+          break;
+        }
+      }
+    }
+  }
+}
+
+// ----------------------------------------------------------------------------
+// SetROM
+// ----------------------------------------------------------------------------
+static inline void memory_SetROM(uint address, byte rom) {
+  memory_rom[address] = rom;
+  if(!rom) {
+    memory_romPage[address >> 8] = false;
+  }
+}
+
+// ----------------------------------------------------------------------------
+// Materialize
+// Copies a page that is mapped onto an external buffer back into memory_ram,
+// so that it can be partially overwritten.
+// ----------------------------------------------------------------------------
+static void memory_Materialize(uint page) {
+  byte* data = memory_ram + (page << 8);
+  if(memory_page[page] != data) {
+    if(memory_page[page] != NULL) {
+      memcpy(data, memory_page[page], MEMORY_PAGE_SIZE);
+    }
+    memory_page[page] = data;
+  }
+}
+
+// ----------------------------------------------------------------------------
+// MaterializePages
+// ----------------------------------------------------------------------------
+static void memory_MaterializePages(uint address, uint size) {
+  if(size == 0) {
+    return;
+  }
+  uint last = (address + size - 1) >> 8;
+  for(uint page = address >> 8; page <= last; page++) {
+    memory_Materialize(page);
+  }
+}
+
 // ----------------------------------------------------------------------------
 // Reset
 // ----------------------------------------------------------------------------
 void memory_Reset( ) {
   uint index;
+  for(index = 0; index < MEMORY_PAGES; index++) {
+    memory_page[index] = memory_ram + (index << 8);
+    memory_romPage[index] = (index >= (16384 >> 8));
+    memory_watched[index] = false;
+  }
   for(index = 0; index < MEMORY_SIZE; index++) {
     memory_ram[index] = 0;
     memory_rom[index] = 1;
@@ -43,14 +144,15 @@ void memory_Reset( ) {
   for(index = 0; index < 16384; index++) {
     memory_rom[index] = 0;
   }
+  memory_MapPages(0, MEMORY_SIZE);
 
   // Debug, reset write count to High Score SRAM
   hs_sram_write_count = 0;
 }
 // ----------------------------------------------------------------------------
-// Read
+// ReadSlow
 // ----------------------------------------------------------------------------
-byte memory_Read(word address) {
+byte memory_ReadSlow(word address) {
   byte tmp_byte;
 
   if( cartridge_pokey && address == POKEY_RANDOM )
@@ -61,6 +163,7 @@ byte memory_Read(word address) {
   switch ( address ) {
   case INTIM:
   case INTIM | 0x2:
+    riot_SyncTimer( );
 	memory_ram[INTFLG] &= 0x7f;
     return memory_ram[INTIM];
 	break;
@@ -71,15 +174,21 @@ byte memory_Read(word address) {
 	 return tmp_byte; 
      break;
   default:
-    return memory_ram[address];
+    return memory_Peek(address);
     break;
   }
 }
 
 // ----------------------------------------------------------------------------
-// Write
+// WriteSlow
 // ----------------------------------------------------------------------------
-void memory_Write(word address, byte data) {
+void memory_WriteSlow(word address, byte data) {
+  uint page = address >> 8;
+  memory_pageVersion[page]++;
+  if(memory_watched[page]) {
+    memory_watched[page] = false;
+    memory_MapPages(address, 1);
+  }
 
   if(!memory_rom[address]) {
 
@@ -165,15 +274,19 @@ if( address >= 0x1000 && address <= 0x17FF )
         memory_ram[address] = data;
         if(address >= 8256 && address <= 8447) {
           memory_ram[address - 8192] = data;
+          memory_pageVersion[page - 32]++;
         }
         else if(address >= 8512 && address <= 8702) {
           memory_ram[address - 8192] = data;
+          memory_pageVersion[page - 32]++;
         }
         else if(address >= 64 && address <= 255) {
           memory_ram[address + 8192] = data;
+          memory_pageVersion[page + 32]++;
         }
         else if(address >= 320 && address <= 511) {
           memory_ram[address + 8192] = data;
+          memory_pageVersion[page + 32]++;
         }
         break;
     }
@@ -188,10 +301,12 @@ if( address >= 0x1000 && address <= 0x17FF )
 // ----------------------------------------------------------------------------
 void memory_WriteROM(word address, word size, const byte* data) {
   if((address + size) <= MEMORY_SIZE && data != NULL) {
+    memory_MaterializePages(address, size);
     for(uint index = 0; index < size; index++) {
       memory_ram[address + index] = data[index];
-      memory_rom[address + index] = 1;
+      memory_SetROM(address + index, 1);
     }
+    memory_MapPages(address, size);
   }
 }
 
@@ -200,11 +315,93 @@ void memory_WriteROM(word address, word size, const byte* data) {
 // ----------------------------------------------------------------------------
 void memory_ClearROM(word address, word size) {
   if((address + size) <= MEMORY_SIZE) {
+    memory_MaterializePages(address, size);
     for(uint index = 0; index < size; index++) {
       memory_ram[address + index] = 0;
-      memory_rom[address + index] = 0;
+      memory_SetROM(address + index, 0);
     }
+    memory_MapPages(address, size);
+  }
+}
+
+// ----------------------------------------------------------------------------
+// MapROM
+// Maps the specified range as ROM directly onto the data buffer, without
+// copying. The buffer must remain valid until it is unmapped (memory_Reset,
+// memory_ClearROM, memory_UnmapROM or another mapping of the same pages).
+// Pages only partially covered by the range are copied.
+// ----------------------------------------------------------------------------
+void memory_MapROM(word address, word size, const byte* data) {
+  if((address + size) <= MEMORY_SIZE && data != NULL && size > 0) {
+    uint end = address + size;
+    uint index = address;
+    while(index < end) {
+      uint page = index >> 8;
+      uint offset = index & 255;
+      uint length = MEMORY_PAGE_SIZE - offset;
+      if(length > end - index) {
+        length = end - index;
+      }
+      if(length == MEMORY_PAGE_SIZE) {
+        memory_page[page] = (byte*)data + (index - address);
+        if(!memory_romPage[page]) {
+          memset(memory_rom + index, 1, MEMORY_PAGE_SIZE);
+          memory_romPage[page] = true;
+        }
+      }
+      else {
+        memory_Materialize(page);
+        memcpy(memory_ram + index, data + (index - address), length);
+        for(uint offset = 0; offset < length; offset++) {
+          memory_SetROM(index + offset, 1);
+        }
+      }
+      index += length;
+    }
+    memory_MapPages(address, size);
+  }
+}
+
+// ----------------------------------------------------------------------------
+// UnmapROM
+// Copies every page mapped onto an external buffer back into memory_ram.
+// Called before such a buffer is released.
+// ----------------------------------------------------------------------------
+void memory_UnmapROM( ) {
+  memory_MaterializePages(0, MEMORY_SIZE);
+  memory_MapPages(0, MEMORY_SIZE);
+}
+
+// ----------------------------------------------------------------------------
+// Watch
+// Routes the next write to a plain RAM page through the slow handler, which
+// bumps the page version and restores the direct mapping. Other pages
+// already take the slow handler (or cannot be written).
+// ----------------------------------------------------------------------------
+void memory_Watch(byte page) {
+  if(memory_writeMap[page] != NULL) {
+    memory_watched[page] = true;
+    memory_writeMap[page] = NULL;
+  }
+}
+
+// ----------------------------------------------------------------------------
+// IsPlain
+// Whether a read (or write) of the address is a plain memory access: no
+// device registers, no bank switching and no value that changes with the
+// cycle it is accessed on.
+// ----------------------------------------------------------------------------
+bool memory_IsPlain(word address, bool write) {
+  if(address < 32 || (address >= 640 && address < 768)) {
+    return false; // TIA and RIOT
+  }
+  if(cartridge_pokey && address >= 0x4000 && address <= 0x400f) {
+    return false;
+  }
+  if(write) {
+    return address != WSYNC && !memory_rom[address];
   }
+  return true;
 }
 
 extern "C" byte* 
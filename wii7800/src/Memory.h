@@ -25,6 +25,8 @@
 #ifndef MEMORY_H
 #define MEMORY_H
 #define MEMORY_SIZE 65536
+#define MEMORY_PAGE_SIZE 256
+#define MEMORY_PAGES (MEMORY_SIZE / MEMORY_PAGE_SIZE)
 
 #include "Equates.h"
 #include "Bios.h"
@@ -37,12 +39,55 @@ typedef unsigned short word;
 typedef unsigned int uint;
 
 extern void memory_Reset( );
-extern byte memory_Read(word address);
-extern void memory_Write(word address, byte data);
+extern byte memory_ReadSlow(word address);
+extern void memory_WriteSlow(word address, byte data);
 extern void memory_WriteROM(word address, word size, const byte* data);
 extern void memory_ClearROM(word address, word size);
+extern void memory_MapROM(word address, word size, const byte* data);
+extern void memory_UnmapROM( );
+extern bool memory_IsPlain(word address, bool write);
+extern void memory_Watch(byte page);
 extern byte memory_ram[MEMORY_SIZE];
 extern byte memory_rom[MEMORY_SIZE];
+extern byte* memory_page[MEMORY_PAGES];
+extern byte* memory_readMap[MEMORY_PAGES];
+extern byte* memory_writeMap[MEMORY_PAGES];
+extern uint memory_pageVersion[MEMORY_PAGES];
+extern int hs_sram_write_count;
+
+// ----------------------------------------------------------------------------
+// Peek
+// Reads the current contents of an address without side effects. ROM pages
+// may be mapped directly onto the cartridge or BIOS buffers, so anything
+// other than the CPU that reads ROM contents (Maria DMA, vectors) must use
+// this rather than memory_ram.
+// ----------------------------------------------------------------------------
+inline byte memory_Peek(word address) {
+  return memory_page[address >> 8][address & 255];
+}
+
+// ----------------------------------------------------------------------------
+// Read
+// Pages with a direct pointer are plain memory, a null page falls back to
+// the register handler.
+// ----------------------------------------------------------------------------
+inline byte memory_Read(word address) {
+  byte* page = memory_readMap[address >> 8];
+  return page? page[address & 255]: memory_ReadSlow(address);
+}
+
+// ----------------------------------------------------------------------------
+// Write
+// ----------------------------------------------------------------------------
+inline void memory_Write(word address, byte data) {
+  byte* page = memory_writeMap[address >> 8];
+  if(page) {
+    page[address & 255] = data;
+  }
+  else {
+    memory_WriteSlow(address, data);
+  }
+}
 
 extern "C" byte* get_memory_ram();
 
@@ -42,6 +42,7 @@
 #include <SDL.h>
 #include "Pokey.h"
 #include "Prosystem.h"
+#include "Sound.h"
 #define POKEY_NOTPOLY5 0x80
 #define POKEY_POLY4 0x40
 #define POKEY_PURE 0x20
@@ -61,6 +62,8 @@
 #define POKEY_POLY5_SIZE 0x001f
 #define POKEY_POLY9_SIZE 0x01ff
 #define POKEY_POLY17_SIZE 0x0001ffff
+#define POKEY_POLY17_BITS (POKEY_POLY17_SIZE + 14)
+#define POKEY_POLY17_WORDS ((POKEY_POLY17_BITS + 31) >> 5)
 #define POKEY_CHANNEL1 0
 #define POKEY_CHANNEL2 1
 #define POKEY_CHANNEL3 2
@@ -69,7 +72,7 @@
 
 #define SK_RESET	0x03
 
-byte pokey_buffer[POKEY_BUFFER_SIZE] = {0};
+byte __attribute__((aligned(4))) pokey_buffer[POKEY_BUFFER_SIZE] = {0};
 uint pokey_size = 524;
 
 static uint pokey_frequency = 1787520;
@@ -82,7 +85,7 @@ static byte pokey_output[4];
 static byte pokey_outVol[4];
 static byte pokey_poly04[POKEY_POLY4_SIZE] = {1,1,0,1,1,1,0,0,0,0,1,0,1,0,0};
 static byte pokey_poly05[POKEY_POLY5_SIZE] = {0,0,1,1,0,0,0,1,1,1,1,0,0,1,0,1,0,1,1,0,1,1,1,0,1,0,0,0,0,0,1};
-static byte pokey_poly17[POKEY_POLY17_SIZE];
+static uint pokey_poly17[POKEY_POLY17_WORDS];
 static uint pokey_poly17Size;
 static uint pokey_polyAdjust;
 static uint pokey_poly04Cntr;
@@ -91,19 +94,22 @@ static uint pokey_poly17Cntr;
 static uint pokey_divideMax[4];
 static uint pokey_divideCount[4];
 static uint pokey_sampleMax;
-static uint pokey_sampleCount[2];
+static uint pokey_sampleCount;
 static uint pokey_baseMultiplier;
 
 static byte rand9[0x1ff];
-static byte rand17[0x1ffff];
+static bool rand_initialized = false;
 static uint r9;
 static uint r17;
 static byte SKCTL;
+static byte AUDCTL;
 byte RANDOM;
 
 static ulong random_scanline_counter;
 static ulong prev_random_scanline_counter;
 
+static byte __attribute__((aligned(4))) pokey_channel[4][POKEY_BUFFER_SIZE];
+
 static void rand_init(byte *rng, int size, int left, int right, int add)
 {
     int mask = (1 << size) - 1;
@@ -111,16 +117,49 @@ static void rand_init(byte *rng, int size, int left, int right, int add)
 
     for( i = 0; i < mask; i++ )
 	{
-		if (size == 17)
-			*rng = x >> 6;	/* use bits 6..13 */
-		else
-			*rng = x;		/* use bits 0..7 */
+		*rng = x;		/* use bits 0..7 */
         rng++;
         /* calculate next bit */
 		x = ((x << left) + (x >> right) + add) & mask;
 	}
 }
 
+/* 
+ * The low 14 bits of the 17 bit generator shift down by one bit per step, so
+ * bit k of state n is bit 0 of state n + k. Only bit 0 of each state is kept,
+ * packed 32 to a word; it is the poly17 noise bit, and the RANDOM byte for a
+ * state (bits 6..13) is the 8 bits starting 6 states later.
+ */
+static void rand_init17( )
+{
+    int mask = POKEY_POLY17_SIZE;
+    int i, x = 0;
+
+    for( i = 0; i < POKEY_POLY17_WORDS; i++ )
+        pokey_poly17[i] = 0;
+
+    for( i = 0; i < POKEY_POLY17_BITS; i++ )
+	{
+        pokey_poly17[i >> 5] |= (uint)(x & 1) << (i & 31);
+		x = ((x << 16) + (x >> 1) + 0x1c000) & mask;
+	}
+}
+
+static inline byte rand_bit17( uint index )
+{
+    return (pokey_poly17[index >> 5] >> (index & 31)) & 1;
+}
+
+static inline byte rand_byte17( uint index )
+{
+    index += 6;
+    uint shift = index & 31;
+    uint bits = pokey_poly17[index >> 5] >> shift;
+    if( shift > 24 )
+        bits |= pokey_poly17[(index >> 5) + 1] << (32 - shift);
+    return (byte)bits;
+}
+
 void pokey_setSampleRate( uint rate ) {
     pokey_sampleRate = rate;
 }
@@ -129,9 +168,12 @@ void pokey_setSampleRate( uint rate ) {
 // Reset
 // ----------------------------------------------------------------------------
 void pokey_Reset( ) {
-  for(int index = 0; index < POKEY_POLY17_SIZE; index++) {
-    pokey_poly17[index] = rand( ) & 1;
+  if(!rand_initialized) {
+    rand_init(rand9, 9, 8, 1, 0x00180);
+    rand_init17( );
+    rand_initialized = true;
   }
+
   pokey_polyAdjust = 0;
   pokey_poly04Cntr = 0;
   pokey_poly05Cntr = 0;
@@ -139,8 +181,7 @@ void pokey_Reset( ) {
 
   pokey_sampleMax = ((uint)pokey_frequency << 8) / pokey_sampleRate;
 
-  pokey_sampleCount[0] = 0;
-  pokey_sampleCount[1] = 0;
+  pokey_sampleCount = 0;
 
   pokey_poly17Size = POKEY_POLY17_SIZE;
 
@@ -156,11 +197,8 @@ void pokey_Reset( ) {
   pokey_audctl = 0;
   pokey_baseMultiplier = POKEY_DIV_64;
 
-  /* initialize the random arrays */
-  rand_init(rand9,   9, 8, 1, 0x00180);
-  rand_init(rand17, 17,16, 1, 0x1c000);
-
   SKCTL = SK_RESET;
+  AUDCTL = 0;
   RANDOM = 0;
 
   r9 = 0;
@@ -197,13 +235,13 @@ byte pokey_GetRegister(word address) {
         r9 = 0;
         r17 = 0;
       }
-      if( pokey_audctl & POKEY_POLY9 )
+      if( AUDCTL & POKEY_POLY9 )
       {
         RANDOM = rand9[r9];
       }
       else
       {
-        RANDOM = rand17[r17];
+        RANDOM = rand_byte17(r17);
       }
 
       prev_random_scanline_counter = curr_scanline_counter;
@@ -218,16 +256,13 @@ byte pokey_GetRegister(word address) {
 }
 
 // ----------------------------------------------------------------------------
-// SetRegister
+// WriteRegister
 // ----------------------------------------------------------------------------
-void pokey_SetRegister(word address, byte value) {
+// Applies a logged write to the sound state, on the thread synthesizing it.
+void pokey_WriteRegister(word address, byte value) {
 	byte channelMask;
   switch(address) {
 
-    case POKEY_SKCTLS:
-      SKCTL = value;
-      return;
-
     case POKEY_AUDF1:
       pokey_audf[POKEY_CHANNEL1] = value;
       channelMask = 1 << POKEY_CHANNEL1;
@@ -382,87 +417,195 @@ void pokey_SetRegister(word address, byte value) {
 }
 
 // ----------------------------------------------------------------------------
-// Process
+// RenderChannel
 // ----------------------------------------------------------------------------
-void pokey_Process(uint length) 
-{
-  byte* buffer = pokey_buffer + pokey_soundCntr;
-#ifdef BIG_ENDIAN
-  uint* sampleCntrPtrB = (uint*)((byte*)&pokey_sampleCount[0] + 3);
-#else
-  uint* sampleCntrPtrB = (uint*)((byte*)&pokey_sampleCount[0] + 1);
-#endif
-  uint size = length;
-
-  while(length) {
-
-    byte currentValue;
-    byte nextEvent = POKEY_SAMPLE;
-    uint eventMin = *sampleCntrPtrB;
-
-    byte channel;
-    for(channel = POKEY_CHANNEL1; channel <= POKEY_CHANNEL4; channel++) {
-      if(pokey_divideCount[channel] <= eventMin) {
-        eventMin = pokey_divideCount[channel];
-        nextEvent = channel;
+// Renders the output volume of one channel for length samples. Each channel
+// only depends on the shared poly counters, which are a function of time, so
+// the channels are run one after another rather than interleaved event by
+// event. Returns whether the channel had an event, and the clock of its last
+// one within the block.
+static bool pokey_RenderChannel(byte channel, byte* target, uint length, uint& lastEvent) {
+  uint sampleCount = pokey_sampleCount;
+  uint divideCount = pokey_divideCount[channel];
+  uint divideMax = pokey_divideMax[channel];
+  byte audc = pokey_audc[channel];
+  byte output = pokey_output[channel];
+  byte outVol = pokey_outVol[channel];
+
+  // Events after the first are divideMax clocks apart, so the poly counters
+  // advance by a constant step that only needs wrapping once.
+  uint step04 = divideMax % POKEY_POLY4_SIZE;
+  uint step05 = divideMax % POKEY_POLY5_SIZE;
+  uint step17 = divideMax % pokey_poly17Size;
+  uint poly04Cntr = 0;
+  uint poly05Cntr = 0;
+  uint poly17Cntr = 0;
+  uint clock = 0;
+  bool event = false;
+
+  for(uint index = 0; index < length; index++) {
+    uint remaining = sampleCount >> 8;
+    while(divideCount <= remaining) {
+      remaining -= divideCount;
+      clock += divideCount;
+      if(!event) {
+        uint elapsed = pokey_polyAdjust + clock;
+        poly04Cntr = (pokey_poly04Cntr + elapsed) % POKEY_POLY4_SIZE;
+        poly05Cntr = (pokey_poly05Cntr + elapsed) % POKEY_POLY5_SIZE;
+        poly17Cntr = (pokey_poly17Cntr + elapsed) % pokey_poly17Size;
       }
-    }
-    
-    for(channel = POKEY_CHANNEL1; channel <= POKEY_CHANNEL4; channel++) {
-      pokey_divideCount[channel] -= eventMin;
-    }
-
-    *sampleCntrPtrB -= eventMin;
-    pokey_polyAdjust += eventMin;
-
-    if(nextEvent != POKEY_SAMPLE) {
-      pokey_poly04Cntr = (pokey_poly04Cntr + pokey_polyAdjust) % POKEY_POLY4_SIZE;
-      pokey_poly05Cntr = (pokey_poly05Cntr + pokey_polyAdjust) % POKEY_POLY5_SIZE;
-      pokey_poly17Cntr = (pokey_poly17Cntr + pokey_polyAdjust) % pokey_poly17Size;
-      pokey_polyAdjust = 0;
-      pokey_divideCount[nextEvent] += pokey_divideMax[nextEvent];
+      else {
+        poly04Cntr += step04;
+        if(poly04Cntr >= POKEY_POLY4_SIZE) poly04Cntr -= POKEY_POLY4_SIZE;
+        poly05Cntr += step05;
+        if(poly05Cntr >= POKEY_POLY5_SIZE) poly05Cntr -= POKEY_POLY5_SIZE;
+        poly17Cntr += step17;
+        if(poly17Cntr >= pokey_poly17Size) poly17Cntr -= pokey_poly17Size;
+      }
+      event = true;
+      lastEvent = clock;
+      divideCount = divideMax;
 
-      if((pokey_audc[nextEvent] & POKEY_NOTPOLY5) || pokey_poly05[pokey_poly05Cntr]) {
-        if(pokey_audc[nextEvent] & POKEY_PURE) {
-          pokey_output[nextEvent] = !pokey_output[nextEvent];
+      if((audc & POKEY_NOTPOLY5) || pokey_poly05[poly05Cntr]) {
+        if(audc & POKEY_PURE) {
+          output = !output;
         }
-        else if (pokey_audc[nextEvent] & POKEY_POLY4) {
-          pokey_output[nextEvent] = pokey_poly04[pokey_poly04Cntr];
+        else if (audc & POKEY_POLY4) {
+          output = pokey_poly04[poly04Cntr];
         }
         else {
-          pokey_output[nextEvent] = pokey_poly17[pokey_poly17Cntr];
+          output = rand_bit17(poly17Cntr);
         }
       }
+      outVol = (output)? audc & POKEY_VOLUME_MASK: 0;
+    }
+    divideCount -= remaining;
+    clock += remaining;
+    target[index] = outVol;
+    sampleCount = (sampleCount & 0xff) + pokey_sampleMax;
+  }
 
-      if(pokey_output[nextEvent]) {
-        pokey_outVol[nextEvent] = pokey_audc[nextEvent] & POKEY_VOLUME_MASK;
-      }
-      else {
-        pokey_outVol[nextEvent] = 0;
+  pokey_divideCount[channel] = divideCount;
+  pokey_output[channel] = output;
+  pokey_outVol[channel] = outVol;
+  return event;
+}
+
+// ----------------------------------------------------------------------------
+// Mix
+// ----------------------------------------------------------------------------
+// Sums the four channel buffers into pokey_buffer. A channel volume is at
+// most 15, so four samples are summed, scaled and offset a word at a time
+// without carrying into each other.
+static void pokey_Mix(uint start, uint length) {
+  uint index = start;
+  uint end = start + length;
+
+  for(; index < end && (index & 3); index++) {
+    byte value = pokey_channel[0][index] + pokey_channel[1][index] + pokey_channel[2][index] + pokey_channel[3][index];
+    pokey_buffer[index] = (value << 2) + 8;
+  }
+  for(; index + 4 <= end; index += 4) {
+    uint value = *(uint*)(pokey_channel[0] + index) + *(uint*)(pokey_channel[1] + index) + *(uint*)(pokey_channel[2] + index) + *(uint*)(pokey_channel[3] + index);
+    *(uint*)(pokey_buffer + index) = (value << 2) + 0x08080808;
+  }
+  for(; index < end; index++) {
+    byte value = pokey_channel[0][index] + pokey_channel[1][index] + pokey_channel[2][index] + pokey_channel[3][index];
+    pokey_buffer[index] = (value << 2) + 8;
+  }
+}
+
+// ----------------------------------------------------------------------------
+// RenderBlock
+// ----------------------------------------------------------------------------
+// Renders length samples at the current register state into a contiguous
+// part of the buffer, then moves the sample counter and the poly counters to
+// the end of the block.
+static void pokey_RenderBlock(uint length) {
+  bool event = false;
+  uint lastEvent = 0;
+  for(byte channel = POKEY_CHANNEL1; channel <= POKEY_CHANNEL4; channel++) {
+    uint clock;
+    if(pokey_RenderChannel(channel, pokey_channel[channel] + pokey_soundCntr, length, clock)) {
+      if(!event || clock > lastEvent) {
+        lastEvent = clock;
       }
+      event = true;
     }
-    else {
-#ifdef BIG_ENDIAN
-      *(pokey_sampleCount + 1) += pokey_sampleMax;
-#else 
-      *pokey_sampleCount += pokey_sampleMax;
-#endif
-      currentValue = 0;
-
-      for(channel = POKEY_CHANNEL1; channel <= POKEY_CHANNEL4; channel++) {
-        currentValue += pokey_outVol[channel];
-      }
+  }
+  pokey_Mix(pokey_soundCntr, length);
+
+  uint clocks = 0;
+  for(uint index = 0; index < length; index++) {
+    clocks += pokey_sampleCount >> 8;
+    pokey_sampleCount = (pokey_sampleCount & 0xff) + pokey_sampleMax;
+  }
+
+  // The poly counters are brought up to date at the last channel event, as
+  // the event loop did, so that a change of the poly17 size by AUDCTL wraps
+  // them from the same point.
+  if(event) {
+    uint elapsed = pokey_polyAdjust + lastEvent;
+    pokey_poly04Cntr = (pokey_poly04Cntr + elapsed) % POKEY_POLY4_SIZE;
+    pokey_poly05Cntr = (pokey_poly05Cntr + elapsed) % POKEY_POLY5_SIZE;
+    pokey_poly17Cntr = (pokey_poly17Cntr + elapsed) % pokey_poly17Size;
+    pokey_polyAdjust = clocks - lastEvent;
+  }
+  else {
+    pokey_polyAdjust += clocks;
+  }
+}
 
-      currentValue = (currentValue << 2) + 8;
-      *buffer++ = currentValue;
-      length--;
+// ----------------------------------------------------------------------------
+// Process
+// ----------------------------------------------------------------------------
+void pokey_Process(uint length) {
+  while(length != 0) {
+    uint span = pokey_size - pokey_soundCntr;
+    if(span > length) {
+      span = length;
+    }
+    pokey_RenderBlock(span);
+    pokey_soundCntr += span;
+    if(pokey_soundCntr >= pokey_size) {
+      pokey_soundCntr = 0;
     }
-  }  
-  
-  pokey_soundCntr += size;
-  if(pokey_soundCntr >= pokey_size) {
-    pokey_soundCntr = 0;
+    length -= span;
+  }
+}
+
+// ----------------------------------------------------------------------------
+// SetRegister
+// ----------------------------------------------------------------------------
+// SKCTL and the poly9 bit of AUDCTL are needed by RANDOM reads and are kept
+// up to date immediately; sound register writes are logged against the
+// current sample of the frame and applied by pokey_WriteRegister when the
+// frame is synthesized.
+void pokey_SetRegister(word address, byte value) {
+  switch(address) {
+    case POKEY_SKCTLS:
+      SKCTL = value;
+      return;
+
+    case POKEY_AUDCTL:
+      AUDCTL = value;
+      break;
+
+    case POKEY_AUDF1:
+    case POKEY_AUDC1:
+    case POKEY_AUDF2:
+    case POKEY_AUDC2:
+    case POKEY_AUDF3:
+    case POKEY_AUDC3:
+    case POKEY_AUDF4:
+    case POKEY_AUDC4:
+      break;
+
+    default:
+      return;
   }
+
+  sound_Log(address, value);
 }
 
 // ----------------------------------------------------------------------------
@@ -80,6 +80,7 @@ typedef unsigned int uint;
 
 extern void pokey_Reset( );
 extern void pokey_SetRegister(word address, byte value);
+extern void pokey_WriteRegister(word address, byte value);
 extern byte pokey_GetRegister(word address);
 extern void pokey_Process(uint length);
 extern void pokey_Clear( );
@@ -57,6 +57,7 @@ void prosystem_Reset( ) {
   if(cartridge_IsLoaded( )) {
     prosystem_paused = false;
     prosystem_frame = 0;
+    sound_Reset( );
     sally_Reset( ); // WII
     region_Reset( );
     tia_Clear( );
@@ -97,6 +98,22 @@ static void prosystem_FireLightGun()
     }      
 }
 
+/*
+ * Returns the cycle at which the lightgun strobe changes within the current
+ * scanline, if it changes before the specified limit (otherwise the limit)
+ */
+static inline uint prosystem_LightGunLimit( uint limit )
+{
+    int strobe = ((int)lightgun_cycle ) - 1;
+    if( ( ( maria_scanline >= lightgun_scanline ) && 
+          ( maria_scanline <= ( lightgun_scanline + 3 ) ) ) && 
+        ( strobe > (int)prosystem_cycles ) && ( strobe < (int)limit ) )
+    {
+        return strobe;
+    }
+    return limit;
+}
+
 uint prosystem_extra_cycles = 0;
 uint dbg_saved_cycles = 0;
 uint dbg_wsync_count = 0;
@@ -177,16 +194,13 @@ void prosystem_ExecuteFrame(const byte* input)
 
         while( prosystem_cycles < cartridge_hblank ) 
         {
-            cycles = sally_ExecuteInstruction( );
-            prosystem_cycles += (cycles << 2 );
-            if( half_cycle ) prosystem_cycles += 2;
-
-            dbg_p6502_cycles += ( cycles << 2 ); // debug
+            // Run until hblank, stopping early at the lightgun strobe
+            uint limit = lightgun ? 
+                prosystem_LightGunLimit( cartridge_hblank ) : cartridge_hblank;
+            cycles = sally_Run( limit - prosystem_cycles, wsync );
+            prosystem_cycles += cycles;
 
-            if( riot_timing ) 
-            {
-                riot_UpdateTimer( cycles );
-            }
+            dbg_p6502_cycles += cycles; // debug
 
             // If lightgun is enabled, check to see if it should be fired
             if( lightgun ) prosystem_FireLightGun();
@@ -215,20 +229,19 @@ void prosystem_ExecuteFrame(const byte* input)
 
         while( !wsync_scanline && prosystem_cycles < CYCLES_PER_SCANLINE ) 
         {
-            cycles = sally_ExecuteInstruction( );            
-            prosystem_cycles += ( cycles << 2 );
-            if( half_cycle ) prosystem_cycles += 2;
+            // Run until the end of the scanline, stopping early at the 
+            // lightgun strobe
+            uint limit = lightgun ? 
+                prosystem_LightGunLimit( CYCLES_PER_SCANLINE ) : 
+                CYCLES_PER_SCANLINE;
+            cycles = sally_Run( limit - prosystem_cycles, wsync );
+            prosystem_cycles += cycles;
 
-            dbg_p6502_cycles += ( cycles << 2 ); // debug
+            dbg_p6502_cycles += cycles; // debug
 
             // If lightgun is enabled, check to see if it should be fired
             if( lightgun ) prosystem_FireLightGun();            
 
-            if( riot_timing ) 
-            {
-                riot_UpdateTimer( cycles );
-            }
-
             if( memory_ram[WSYNC] && wsync ) 
             {
                 dbg_wsync_count++; // debug
@@ -252,11 +265,7 @@ void prosystem_ExecuteFrame(const byte* input)
         // If lightgun is enabled, check to see if it should be fired
         if( lightgun ) prosystem_FireLightGun();
 
-        tia_Process(2);
-        if( cartridge_pokey ) 
-        {
-            pokey_Process(2);
-        }
+        sound_Clock(2);
 
         if( cartridge_pokey ) pokey_Scanline();
     }  
@@ -286,6 +295,9 @@ bool prosystem_Save(std::string filename, bool compress)
   logger_LogInfo("Saving game state to file " + filename + ".");
   
   uint size = 0;
+
+  // Bring INTIM up to date before it is saved
+  riot_SyncTimer( );
   
   uint index;
   for(index = 0; index < 16; index++) {
@@ -304,6 +316,7 @@ bool prosystem_Save(std::string filename, bool compress)
   }
   size += 32;
 
+  sally_SyncFlags( );
   loc_buffer[size++] = sally_a;
   loc_buffer[size++] = sally_x;
   loc_buffer[size++] = sally_y;
@@ -314,13 +327,13 @@ bool prosystem_Save(std::string filename, bool compress)
   loc_buffer[size++] = cartridge_bank;
 
   for(index = 0; index < 16384; index++) {
-    loc_buffer[size + index] = memory_ram[index];
+    loc_buffer[size + index] = memory_Peek(index);
   }
   size += 16384;
   
   if(cartridge_type == CARTRIDGE_TYPE_SUPERCART_RAM) {
     for(index = 0; index < 16384; index++) {
-      loc_buffer[size + index] = memory_ram[16384 + index];
+      loc_buffer[size + index] = memory_Peek(16384 + index);
     } 
     size += 16384;
   }
@@ -459,6 +472,7 @@ bool prosystem_Load(const std::string filename) {
   sally_s = loc_buffer[offset++];
   sally_pc.b.l = loc_buffer[offset++];
   sally_pc.b.h = loc_buffer[offset++];
+  sally_LoadFlags( );
   
   cartridge_StoreBank(loc_buffer[offset++]);
 
@@ -477,6 +491,7 @@ bool prosystem_Load(const std::string filename) {
     }
     offset += 16384; 
   }  
+  maria_FlushCache( );
 
   if( size == 16453 || size == 32837 )
   {
@@ -490,6 +505,8 @@ bool prosystem_Load(const std::string filename) {
       riot_clocks = ( loc_buffer[offset++] << 8 );
       riot_clocks |= loc_buffer[offset++];
 
+      // Schedule the next timer event for the restored state
+      riot_Event( );
   }
 
   return true;
@@ -510,6 +527,7 @@ void prosystem_Pause(bool pause) {
 void prosystem_Close( ) {
   prosystem_active = false;
   prosystem_paused = false;
+  sound_Reset( );
   cartridge_Release( );
   maria_Reset( );
   maria_Clear( );
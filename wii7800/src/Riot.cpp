@@ -34,8 +34,12 @@ word riot_clocks;
 byte riot_dra = 0;
 byte riot_drb = 0;
 
+uint riot_clock = 0;
+uint riot_deadline = RIOT_IDLE;
+
 static bool riot_elapsed;
 static int riot_currentTime;
+static uint riot_start;
 
 // Debug, count the number of times a RIOT timer was used
 unsigned int riot_timer_count = 0;
@@ -51,6 +55,9 @@ void riot_Reset(void) {
 
     riot_elapsed = false;
     riot_currentTime = 0;
+    riot_clock = 0;
+    riot_start = 0;
+    riot_deadline = RIOT_IDLE;
 
     riot_timer_count = 0; // debug    
 }
@@ -254,32 +261,79 @@ riot_timer_count++; // debug
 #endif
     riot_currentTime = riot_clocks * intervals;
     riot_elapsed = false;
+    riot_start = riot_clock;
+    riot_deadline = riot_start + riot_currentTime;
   }
 }
 
 // ----------------------------------------------------------------------------
-// UpdateTimer
+// Event
+// Handles the timer event due at riot_deadline. While counting down, the
+// timer underflows: INTFLG is set and the timer restarts from the clock count
+// (any overshoot is discarded). Once elapsed, the timer stops 256 cycles
+// after the clock count has passed. The next deadline is then scheduled.
 // ----------------------------------------------------------------------------
-void riot_UpdateTimer(byte cycles) {
-  riot_currentTime -= cycles;
-  if(!riot_elapsed && riot_currentTime > 0) {
-    memory_Write(INTIM, riot_currentTime / riot_clocks);
-  }
-  else {
-    if(riot_elapsed) {
-      if(riot_currentTime >= -255) {
-        memory_Write(INTIM, riot_currentTime);
-      }
-      else {
+void riot_Event( ) {
+  if(riot_timing) {
+    if(!riot_elapsed) {
+      if((int)(riot_clock - riot_start) >= riot_currentTime) {
+        riot_start = riot_clock;
+        riot_currentTime = riot_clocks;
         memory_Write(INTIM, 0);
-        riot_timing = false;
+        memory_ram[INTFLG] |= 0x80;
+        riot_elapsed = true;
       }
     }
-    else {
-      riot_currentTime = riot_clocks;
+    else if((int)(riot_clock - riot_start) > riot_currentTime + 255) {
       memory_Write(INTIM, 0);
-	  memory_ram[INTFLG] |= 0x80;
-      riot_elapsed = true;
+      riot_timing = false;
+    }
+  }
+
+  if(!riot_timing) {
+    riot_deadline = riot_clock + RIOT_IDLE;
+  }
+  else if(!riot_elapsed) {
+    riot_deadline = riot_start + riot_currentTime;
+  }
+  else {
+    riot_deadline = riot_start + riot_currentTime + 256;
+  }
+}
+
+// ----------------------------------------------------------------------------
+// SyncTimer
+// Stores the current timer value in INTIM. Between events the timer is only
+// advanced through riot_clock, so INTIM is brought up to date when read.
+// ----------------------------------------------------------------------------
+void riot_SyncTimer( ) {
+  if(riot_timing && riot_clock != riot_start) {
+    int time = riot_currentTime - (int)(riot_clock - riot_start);
+    if(!riot_elapsed) {
+      memory_Write(INTIM, (time > 0)? time / riot_clocks: 0);
     }
+    else {
+      memory_Write(INTIM, time);
+    }
+  }
+}
+
+// ----------------------------------------------------------------------------
+// TimerStable
+// Returns the clock count up to which (exclusive) reading INTIM and INTFLG
+// gives the same values as now.
+// ----------------------------------------------------------------------------
+uint riot_TimerStable( ) {
+  if(!riot_timing) {
+    return riot_deadline;
+  }
+  if(riot_elapsed || riot_clock == riot_start) {
+    return riot_clock + 1;
+  }
+  int time = riot_currentTime - (int)(riot_clock - riot_start);
+  if(time <= 0) {
+    return riot_clock + 1;
   }
+  uint next = riot_clock + (time % riot_clocks) + 1;
+  return ((int)(next - riot_deadline) < 0)? next: riot_deadline;
 }
@@ -32,12 +32,16 @@ typedef unsigned char byte;
 typedef unsigned short word;
 typedef unsigned int uint;
 
+#define RIOT_IDLE 0x40000000
+
 extern void riot_Reset(void);
 extern void riot_SetInput(const byte* input);
 extern void riot_SetDRA(byte data);
 extern void riot_SetDRB(byte data);
 extern void riot_SetTimer(word timer, byte intervals);
-extern void riot_UpdateTimer(byte cycles);
+extern void riot_Event( );
+extern void riot_SyncTimer( );
+extern uint riot_TimerStable( );
 extern bool riot_timing;
 extern word riot_timer;
 extern byte riot_intervals;
@@ -45,4 +49,20 @@ extern byte riot_dra;
 extern byte riot_drb;
 extern word riot_clocks;
 
+// The number of cycles credited to the timer, and the clock count at which
+// the next timer event (underflow or stop) is due
+extern uint riot_clock;
+extern uint riot_deadline;
+
+// ----------------------------------------------------------------------------
+// UpdateTimer
+// Credits cycles to the timer, handling the timer event when it is due.
+// ----------------------------------------------------------------------------
+static inline void riot_UpdateTimer(byte cycles) {
+  riot_clock += cycles;
+  if((int)(riot_clock - riot_deadline) >= 0) {
+    riot_Event( );
+  }
+}
+
 #endif
@@ -24,6 +24,9 @@
 // ----------------------------------------------------------------------------
 #include "Sally.h"
 #include "Cartridge.h"
+#include "Logger.h"
+#include <string.h>
+#define SALLY_SOURCE "Sally.cpp"
 
 byte sally_a = 0;
 byte sally_x = 0;
@@ -32,8 +35,18 @@ byte sally_p = 0;
 byte sally_s = 0;
 pair sally_pc = {0};
 
+// The N, Z, C and V flags are kept apart from sally_p and only built into it
+// when the status register itself is needed (see sally_SyncFlags). N is bit
+// 7 of sally_n, Z is set when sally_z is zero, C is sally_c (0 or 1) and V is
+// bit 6 of sally_v.
+static byte sally_n;
+static byte sally_z;
+static byte sally_c;
+static byte sally_v;
+
 static byte sally_opcode;
 static pair sally_address;
+static pair sally_operand;
 static uint sally_cycles;
 
 // Whether the last operation resulted in a half cycle. (needs to be taken 
@@ -55,6 +68,31 @@ struct Flag {
 
 static const Flag SALLY_FLAG = {0x01, 0x02, 0x04, 0x08, 0x10, 0x20, 0x40, 0x80};
 
+#define SALLY_FLAGS_LAZY 0xc3
+
+// ----------------------------------------------------------------------------
+// SyncFlags
+// Builds the N, Z, C and V flags into sally_p.
+// ----------------------------------------------------------------------------
+void sally_SyncFlags( ) {
+  sally_p &= ~SALLY_FLAGS_LAZY;
+  sally_p |= (sally_n & SALLY_FLAG.N) | (sally_v & SALLY_FLAG.V) | sally_c;
+  if(!sally_z) {
+    sally_p |= SALLY_FLAG.Z;
+  }
+}
+
+// ----------------------------------------------------------------------------
+// LoadFlags
+// Takes the N, Z, C and V flags from sally_p, after it has been set.
+// ----------------------------------------------------------------------------
+void sally_LoadFlags( ) {
+  sally_n = sally_p;
+  sally_z = !(sally_p & SALLY_FLAG.Z);
+  sally_c = sally_p & SALLY_FLAG.C;
+  sally_v = sally_p;
+}
+
 struct Vector {
   word H;
   word L;
@@ -83,6 +121,90 @@ static const byte SALLY_CYCLES[256] = {
 	2,5,0,0,0,4,6,0,2,4,0,0,0,4,7,0, // 240 - 255
 };
 
+static const byte SALLY_LENGTH[256] = {
+	1,2,1,1,1,2,2,1,1,2,1,1,1,3,3,1, // 0 - 15
+	2,2,1,1,1,2,2,1,1,3,1,1,1,3,3,1, // 16 - 31
+	3,2,1,1,2,2,2,1,1,2,1,1,3,3,3,1, // 32 - 47
+	2,2,1,1,1,2,2,1,1,3,1,1,1,3,3,1, // 48 - 63
+	1,2,1,1,1,2,2,1,1,2,1,1,3,3,3,1, // 64 - 79
+	2,2,1,1,1,2,2,1,1,3,1,1,1,3,3,1, // 80 - 95
+	1,2,1,1,1,2,2,1,1,2,1,1,3,3,3,1, // 96 - 111
+	2,2,1,1,1,2,2,1,1,3,1,1,1,3,3,1, // 112 - 127
+	1,2,1,1,2,2,2,1,1,1,1,1,3,3,3,1, // 128 - 143
+	2,2,1,1,2,2,2,1,1,3,1,1,1,3,1,1, // 144 - 159
+	2,2,2,1,2,2,2,1,1,2,1,1,3,3,3,1, // 160 - 175
+	2,2,1,1,2,2,2,1,1,3,1,1,3,3,3,1, // 176 - 191
+	2,2,1,1,2,2,2,1,1,2,1,1,3,3,3,1, // 192 - 207
+	2,2,1,1,1,2,2,1,1,3,1,1,1,3,3,1, // 208 - 223
+	2,2,1,1,2,2,2,1,1,2,1,1,3,3,3,1, // 224 - 239
+	2,2,1,1,1,2,2,1,1,3,1,1,1,3,3,1, // 240 - 255
+};
+
+// Addressing mode (low nibble) and kind of memory access of each opcode,
+// used to find loops that can be fast-forwarded
+#define SALLY_MODE_IMPLIED 0
+#define SALLY_MODE_IMMEDIATE 1
+#define SALLY_MODE_ZEROPAGE 2
+#define SALLY_MODE_ZEROPAGEX 3
+#define SALLY_MODE_ZEROPAGEY 4
+#define SALLY_MODE_ABSOLUTE 5
+#define SALLY_MODE_ABSOLUTEX 6
+#define SALLY_MODE_ABSOLUTEY 7
+#define SALLY_MODE_INDIRECT 8
+#define SALLY_MODE_INDIRECTX 9
+#define SALLY_MODE_INDIRECTY 10
+#define SALLY_MODE_RELATIVE 11
+#define SALLY_ACCESS_READ 0x10
+#define SALLY_ACCESS_WRITE 0x20
+#define SALLY_ACCESS_FLOW 0x40
+
+static const byte SALLY_ACCESS[256] = {
+	0x40,0x19,0x00,0x00,0x00,0x12,0x32,0x00,0x00,0x11,0x00,0x00,0x00,0x15,0x35,0x00, // 0 - 15
+	0x4b,0x1a,0x00,0x00,0x00,0x13,0x33,0x00,0x00,0x17,0x00,0x00,0x00,0x16,0x36,0x00, // 16 - 31
+	0x45,0x19,0x00,0x00,0x12,0x12,0x32,0x00,0x00,0x11,0x00,0x00,0x15,0x15,0x35,0x00, // 32 - 47
+	0x4b,0x1a,0x00,0x00,0x00,0x13,0x33,0x00,0x00,0x17,0x00,0x00,0x00,0x16,0x36,0x00, // 48 - 63
+	0x40,0x19,0x00,0x00,0x00,0x12,0x32,0x00,0x00,0x11,0x00,0x00,0x45,0x15,0x35,0x00, // 64 - 79
+	0x4b,0x1a,0x00,0x00,0x00,0x13,0x33,0x00,0x00,0x17,0x00,0x00,0x00,0x16,0x36,0x00, // 80 - 95
+	0x40,0x19,0x00,0x00,0x00,0x12,0x32,0x00,0x00,0x11,0x00,0x00,0x48,0x15,0x35,0x00, // 96 - 111
+	0x4b,0x1a,0x00,0x00,0x00,0x13,0x33,0x00,0x00,0x17,0x00,0x00,0x00,0x16,0x36,0x00, // 112 - 127
+	0x00,0x29,0x00,0x00,0x22,0x22,0x22,0x00,0x00,0x00,0x00,0x00,0x25,0x25,0x25,0x00, // 128 - 143
+	0x4b,0x2a,0x00,0x00,0x23,0x23,0x24,0x00,0x00,0x27,0x00,0x00,0x00,0x26,0x00,0x00, // 144 - 159
+	0x11,0x19,0x11,0x00,0x12,0x12,0x12,0x00,0x00,0x11,0x00,0x00,0x15,0x15,0x15,0x00, // 160 - 175
+	0x4b,0x1a,0x00,0x00,0x13,0x13,0x14,0x00,0x00,0x17,0x00,0x00,0x16,0x16,0x17,0x00, // 176 - 191
+	0x11,0x19,0x00,0x00,0x12,0x12,0x32,0x00,0x00,0x11,0x00,0x00,0x15,0x15,0x35,0x00, // 192 - 207
+	0x4b,0x1a,0x00,0x00,0x00,0x13,0x33,0x00,0x00,0x17,0x00,0x00,0x00,0x16,0x36,0x00, // 208 - 223
+	0x11,0x19,0x00,0x00,0x12,0x12,0x32,0x00,0x00,0x11,0x00,0x00,0x15,0x15,0x35,0x00, // 224 - 239
+	0x4b,0x1a,0x00,0x00,0x00,0x13,0x33,0x00,0x00,0x17,0x00,0x00,0x00,0x16,0x36,0x00, // 240 - 255
+};
+
+// Decoded instruction: the handler (jump table label), the operand bytes,
+// the base cycle count and the instruction length. A null handler marks an
+// entry that has not been decoded yet.
+struct Decoded {
+  const void* handler;
+  pair operand;
+  byte cycles;
+  byte length;
+};
+
+// The decoded instructions of one ROM page. The source is the page pointer
+// (memory_page) the entries were decoded from, so remapping the page
+// (cartridge bank switch, BIOS swap) implicitly invalidates the block.
+struct DecodeBlock {
+  const byte* source;
+  byte page;
+  Decoded entry[MEMORY_PAGE_SIZE];
+};
+
+#define SALLY_DECODE_BLOCKS 64
+
+static DecodeBlock sally_decodeBlocks[SALLY_DECODE_BLOCKS];
+static DecodeBlock* sally_decodePage[MEMORY_PAGES] = {0};
+static uint sally_decodeNext = 0;
+
+byte sally_engine = SALLY_ENGINE_RUN;
+uint sally_verifyErrors = 0;
+
 #if 0
 static char msg[512];
 #endif
@@ -102,6 +224,295 @@ static inline void sally_checkHighScoreSet()
   }
 }
   
+// ----------------------------------------------------------------------------
+// FlushCache
+// ----------------------------------------------------------------------------
+void sally_FlushCache( ) {
+  for(uint index = 0; index < MEMORY_PAGES; index++) {
+    sally_decodePage[index] = NULL;
+  }
+  for(uint index = 0; index < SALLY_DECODE_BLOCKS; index++) {
+    sally_decodeBlocks[index].source = NULL;
+  }
+  sally_decodeNext = 0;
+}
+
+// ----------------------------------------------------------------------------
+// AllocateBlock
+// Assigns a (cleared) decode block to the specified page, evicting the
+// oldest block if required.
+// ----------------------------------------------------------------------------
+static DecodeBlock* sally_AllocateBlock(byte page, const byte* source) {
+  DecodeBlock* block = sally_decodePage[page];
+  if(block == NULL) {
+    block = &sally_decodeBlocks[sally_decodeNext];
+    sally_decodeNext = (sally_decodeNext + 1) % SALLY_DECODE_BLOCKS;
+    if(block->source != NULL) {
+      sally_decodePage[block->page] = NULL;
+    }
+    block->page = page;
+    sally_decodePage[page] = block;
+  }
+  block->source = source;
+  for(uint index = 0; index < MEMORY_PAGE_SIZE; index++) {
+    block->entry[index].handler = NULL;
+  }
+  return block;
+}
+
+// ----------------------------------------------------------------------------
+// Lookup
+// Returns the decode entry for the specified address, or null if the code
+// at that address is not cacheable. Only pages mapped directly onto ROM
+// (cartridge or BIOS) are cached, code running from RAM (or from pages that
+// were copied into RAM) is always decoded from memory.
+// ----------------------------------------------------------------------------
+static inline DecodeBlock* sally_LookupBlock(byte page) {
+  const byte* source = memory_page[page];
+  if(source == NULL || source == memory_ram + (page << 8)) {
+    return NULL;
+  }
+  DecodeBlock* block = sally_decodePage[page];
+  if(block == NULL || block->source != source) {
+    block = sally_AllocateBlock(page, source);
+  }
+  return block;
+}
+
+static inline Decoded* sally_Lookup(pair address) {
+  DecodeBlock* block = sally_LookupBlock(address.b.h);
+  return block != NULL? &block->entry[address.b.l]: NULL;
+}
+
+// ----------------------------------------------------------------------------
+// Idle loops
+// A short loop closed by a backward branch, whose body only loads, compares
+// and transfers (immediate, zero page or absolute operands, no writes). Once
+// two consecutive iterations leave the processor state unchanged, the loop
+// keeps spinning until something it reads changes. Maria and the frame loop
+// only change memory between calls to sally_Run, and the RIOT at its timer
+// events (or whenever INTIM changes, if the loop reads it), so the iterations
+// up to the next of those boundaries are skipped in one step.
+// ----------------------------------------------------------------------------
+#define SALLY_IDLE_LENGTH 16
+
+struct IdleLoop {
+  bool active;
+  bool valid;
+  bool timed;
+  word head;
+  word end;
+  uint cycles;
+  uint maria;
+  uint clock;
+  uint deadline;
+  uint stable;
+  uint matches;
+  uint pending;
+  byte state[5];
+};
+
+// The loop last closed by a backward branch: its first instruction and the
+// address following the branch, whether the body qualifies and reads the
+// RIOT, the (Maria) cycles per iteration, the clock, timer deadline, end of
+// the current INTIM value and processor state when the head was last
+// reached, the consecutive iterations that left the state unchanged, and
+// the iterations of a skip the verify engine still has to execute
+static IdleLoop sally_idle;
+
+uint sally_idleLoops = 0;
+uint sally_idleSkips = 0;
+uint sally_idleCycles = 0;
+
+// ----------------------------------------------------------------------------
+// VerifyFailed
+// ----------------------------------------------------------------------------
+static void sally_VerifyFailed(const char* what, word address) {
+  sally_verifyErrors++;
+  char message[128];
+  sprintf(message, "%s at %04x differs from the interpreter.", what, address);
+  logger_LogError(message, SALLY_SOURCE);
+}
+
+// ----------------------------------------------------------------------------
+// VerifyIdle
+// With the verify engine the iterations of a skip are executed instead, and
+// each one has to reach the head again with the state the skip assumed.
+// ----------------------------------------------------------------------------
+static void sally_VerifyIdle(bool unchanged) {
+  if(sally_idle.pending) {
+    if(unchanged) {
+      sally_idle.pending--;
+    }
+    else {
+      sally_VerifyFailed("Idle loop skip", sally_idle.head);
+      sally_idle.pending = 0;
+    }
+  }
+}
+
+// ----------------------------------------------------------------------------
+// CheckIdle
+// Whether the body of the loop qualifies as idle. Sets the cycle counts of
+// one iteration and whether the body reads the RIOT.
+// ----------------------------------------------------------------------------
+static bool sally_CheckIdle(word head, word end) {
+  uint cycles = 0;
+  uint halfCycles = 0;
+  sally_idle.timed = false;
+
+  word address = head;
+  while((word)(end - address) > 2) {
+    byte opcode = memory_Peek(address);
+    byte access = SALLY_ACCESS[opcode];
+    byte mode = access & 15;
+    if(!SALLY_CYCLES[opcode] || (access & (SALLY_ACCESS_WRITE | SALLY_ACCESS_FLOW))) {
+      return false;
+    }
+    if(opcode == 0x08 || opcode == 0x28 || opcode == 0x48 || opcode == 0x68) {
+      return false; // Stack
+    }
+    if(mode == SALLY_MODE_ZEROPAGE || mode == SALLY_MODE_ABSOLUTE) {
+      word operand = memory_Peek(address + 1);
+      if(mode == SALLY_MODE_ABSOLUTE) {
+        operand |= memory_Peek(address + 2) << 8;
+      }
+      if(!memory_IsPlain(operand, false)) {
+        if(operand >= 640 && operand < 768) {
+          sally_idle.timed = true;
+        }
+        else if(operand >= 32) {
+          return false; // POKEY
+        }
+      }
+      if(opcode == 0x24 && operand == INPT4) {
+        halfCycles++;
+      }
+    }
+    else if(mode != SALLY_MODE_IMPLIED && mode != SALLY_MODE_IMMEDIATE) {
+      return false;
+    }
+    cycles += SALLY_CYCLES[opcode];
+    address += SALLY_LENGTH[opcode];
+  }
+  if((word)(end - address) != 2) {
+    return false;
+  }
+
+  // The closing branch, taken
+  cycles += SALLY_CYCLES[memory_Peek(address)];
+  cycles += ((head >> 8) != (end >> 8))? 2: 1;
+  sally_idle.cycles = cycles;
+  sally_idle.maria = (cycles << 2) + (halfCycles << 1);
+  return true;
+}
+
+// ----------------------------------------------------------------------------
+// Idle
+// Called when a backward branch is taken, before its cycles are credited.
+// Returns the Maria cycles skipped (the RIOT clock is advanced as well).
+// ----------------------------------------------------------------------------
+static uint sally_Idle(uint total, uint budget) {
+  word end = sally_pc.w - (signed char)sally_address.b.l;
+  uint clock = riot_clock + sally_cycles;
+  total += sally_cycles << 2;
+
+  sally_SyncFlags( );
+  byte state[5] = {sally_a, sally_x, sally_y, sally_s, sally_p};
+
+  if(!sally_idle.active || sally_idle.head != sally_pc.w || sally_idle.end != end) {
+    sally_VerifyIdle(false);
+    sally_idle.active = true;
+    sally_idle.head = sally_pc.w;
+    sally_idle.end = end;
+    sally_idle.valid = (word)(end - sally_pc.w) <= SALLY_IDLE_LENGTH && 
+      sally_CheckIdle(sally_pc.w, end);
+    sally_idle.matches = 0;
+    if(sally_idle.valid) {
+      sally_idleLoops++;
+    }
+  }
+  else if(sally_idle.valid) {
+    bool unchanged = clock - sally_idle.clock == sally_idle.cycles && 
+      riot_deadline == sally_idle.deadline &&
+      (int)(clock - sally_idle.stable) < 0 &&
+      !memcmp(state, sally_idle.state, sizeof(state));
+    sally_idle.matches = unchanged? sally_idle.matches + 1: 0;
+    sally_VerifyIdle(unchanged);
+  }
+  if(!sally_idle.valid) {
+    return 0;
+  }
+  memcpy(sally_idle.state, state, sizeof(state));
+  sally_idle.clock = clock;
+  sally_idle.deadline = riot_deadline;
+  sally_idle.stable = sally_idle.timed? riot_TimerStable( ): riot_deadline;
+  if(sally_idle.matches < 2 || sally_idle.pending || total >= budget) {
+    return 0;
+  }
+
+  // Skip the iterations that end before the budget and the next change
+  uint iterations = (budget - total - 1) / sally_idle.maria;
+  int remaining = (int)(sally_idle.stable - clock) - 1;
+  if(remaining <= 0) {
+    return 0;
+  }
+  if((uint)remaining / sally_idle.cycles < iterations) {
+    iterations = (uint)remaining / sally_idle.cycles;
+  }
+  if(!iterations) {
+    return 0;
+  }
+  if(sally_engine == SALLY_ENGINE_VERIFY) {
+    sally_idle.pending = iterations;
+    return 0;
+  }
+  riot_clock += iterations * sally_idle.cycles;
+  sally_idle.clock += iterations * sally_idle.cycles;
+  sally_idleSkips++;
+  sally_idleCycles += iterations * sally_idle.cycles;
+  return iterations * sally_idle.maria;
+}
+
+// ----------------------------------------------------------------------------
+// VerifyDecoded
+// Decodes the instruction at the program counter again, uncached, and
+// compares it with the cached entry. A stale entry is logged and decoded
+// again by the caller.
+// ----------------------------------------------------------------------------
+static bool sally_VerifyDecoded(const Decoded* decoded, const void* const* table) {
+  byte opcode = memory_Peek(sally_pc.w);
+  byte length = SALLY_LENGTH[opcode];
+  pair operand;
+  operand.w = 0;
+  if(length > 1) {
+    operand.b.l = memory_Peek(sally_pc.w + 1);
+    if(length > 2) {
+      operand.b.h = memory_Peek(sally_pc.w + 2);
+    }
+  }
+  if(decoded->handler == table[opcode] && decoded->operand.w == operand.w &&
+     decoded->cycles == SALLY_CYCLES[opcode] && decoded->length == length) {
+    return true;
+  }
+  sally_VerifyFailed("Cached instruction", sally_pc.w);
+  return false;
+}
+
+// ----------------------------------------------------------------------------
+// Fetch
+// Reads the operand bytes of the current instruction.
+// ----------------------------------------------------------------------------
+static inline void sally_Fetch(byte length) {
+  sally_operand.w = 0;
+  if(length > 1) {
+    sally_operand.b.l = memory_Read(sally_pc.w++);
+    if(length > 2) {
+      sally_operand.b.h = memory_Read(sally_pc.w++);
+    }
+  }
+}
+
 // ----------------------------------------------------------------------------
 // Push
 // ----------------------------------------------------------------------------
@@ -135,18 +546,8 @@ sprintf( msg, "Flags: %d", data );
 logger_LogInfo( msg );
 #endif
 
-  if(!data) {
-    sally_p |= SALLY_FLAG.Z;
-  }
-  else {
-    sally_p &= ~SALLY_FLAG.Z;
-  }
-  if(data & 128) {
-    sally_p |= SALLY_FLAG.N;
-  }
-  else {
-    sally_p &= ~SALLY_FLAG.N;
-  }
+  sally_n = data;
+  sally_z = data;
 }
 
 // ----------------------------------------------------------------------------
@@ -197,8 +598,7 @@ sprintf( msg, "Absolute" );
 logger_LogInfo( msg );
 #endif
 
-  sally_address.b.l = memory_Read(sally_pc.w++);
-  sally_address.b.h = memory_Read(sally_pc.w++);
+  sally_address = sally_operand;
 }
 
 // ----------------------------------------------------------------------------
@@ -210,9 +610,7 @@ sprintf( msg, "AbsoluteX" );
 logger_LogInfo( msg );
 #endif
 
-  sally_address.b.l = memory_Read(sally_pc.w++);
-  sally_address.b.h = memory_Read(sally_pc.w++);
-  sally_address.w += sally_x;
+  sally_address.w = sally_operand.w + sally_x;
 }
 
 // ----------------------------------------------------------------------------
@@ -224,9 +622,7 @@ sprintf( msg, "AbsoluteY" );
 logger_LogInfo( msg );
 #endif
 
-  sally_address.b.l = memory_Read(sally_pc.w++);
-  sally_address.b.h = memory_Read(sally_pc.w++);
-  sally_address.w += sally_y;
+  sally_address.w = sally_operand.w + sally_y;
 }
 
 // ----------------------------------------------------------------------------
@@ -238,7 +634,7 @@ sprintf( msg, "Immediate" );
 logger_LogInfo( msg );
 #endif
 
-  sally_address.w = sally_pc.w++;
+  sally_address.w = sally_pc.w - 1;
 }
 
 // ----------------------------------------------------------------------------
@@ -250,9 +646,7 @@ sprintf( msg, "Indirect" );
 logger_LogInfo( msg );
 #endif
 
-  pair base;
-  base.b.l = memory_Read(sally_pc.w++);
-  base.b.h = memory_Read(sally_pc.w++);
+  pair base = sally_operand;
   sally_address.b.l = memory_Read(base.w);
   sally_address.b.h = memory_Read(base.w + 1);
 }
@@ -266,7 +660,7 @@ sprintf( msg, "IndirectX" );
 logger_LogInfo( msg );
 #endif
 
-  sally_address.b.l = memory_Read(sally_pc.w++) + sally_x;
+  sally_address.b.l = sally_operand.b.l + sally_x;
   sally_address.b.h = memory_Read(sally_address.b.l + 1);
   sally_address.b.l = memory_Read(sally_address.b.l);
 }
@@ -280,7 +674,7 @@ sprintf( msg, "IndirectY" );
 logger_LogInfo( msg );
 #endif
 
-  sally_address.b.l = memory_Read(sally_pc.w++);
+  sally_address.b.l = sally_operand.b.l;
   sally_address.b.h = memory_Read(sally_address.b.l + 1);
   sally_address.b.l = memory_Read(sally_address.b.l);
   sally_address.w += sally_y;
@@ -295,7 +689,7 @@ sprintf( msg, "Relative" );
 logger_LogInfo( msg );
 #endif
 
-  sally_address.w = memory_Read(sally_pc.w++);
+  sally_address.w = sally_operand.b.l;
 }
 
 // ----------------------------------------------------------------------------
@@ -307,7 +701,7 @@ sprintf( msg, "ZeroPage" );
 logger_LogInfo( msg );
 #endif
 
-  sally_address.w = memory_Read(sally_pc.w++);
+  sally_address.w = sally_operand.b.l;
 }
 
 // ----------------------------------------------------------------------------
@@ -319,7 +713,7 @@ sprintf( msg, "ZeroPageX" );
 logger_LogInfo( msg );
 #endif
 
-  sally_address.w = memory_Read(sally_pc.w++);
+  sally_address.w = sally_operand.b.l;
   sally_address.b.l += sally_x;
 }
 
@@ -332,7 +726,7 @@ sprintf( msg, "ZeroPageY" );
 logger_LogInfo( msg );
 #endif
 
-  sally_address.w = memory_Read(sally_pc.w++);
+  sally_address.w = sally_operand.b.l;
   sally_address.b.l += sally_y;
 }
 
@@ -348,7 +742,7 @@ logger_LogInfo( msg );
   byte data = memory_Read(sally_address.w);
     
   if(sally_p & SALLY_FLAG.D) {
-    word al = (sally_a & 15) + (data & 15) + (sally_p & SALLY_FLAG.C);
+    word al = (sally_a & 15) + (data & 15) + sally_c;
     word ah = (sally_a >> 4) + (data >> 4);
 
     if(al > 9) {
@@ -356,57 +750,24 @@ logger_LogInfo( msg );
       ah++;
     }
 
-    if(!(sally_a + data + (sally_p & SALLY_FLAG.C))) {
-      sally_p |= SALLY_FLAG.Z;
-    }
-    else {
-      sally_p &= ~SALLY_FLAG.Z;
-    }
-
-    if((ah & 8) != 0) {
-      sally_p |= SALLY_FLAG.N;      
-    }
-    else {
-      sally_p &= ~SALLY_FLAG.N;
-    }
-
-    if(~(sally_a ^ data) & ((ah << 4) ^ sally_a) & 128) {
-      sally_p |= SALLY_FLAG.V;
-    }
-    else {
-      sally_p &= ~SALLY_FLAG.V;
-    }
+    sally_z = (sally_a + data + sally_c) != 0;
+    sally_n = ah << 4;
+    sally_v = (~(sally_a ^ data) & ((ah << 4) ^ sally_a) & 128) >> 1;
 
     if(ah > 9) {
       ah += 6;
     }
 
-    if(ah > 15) {
-      sally_p |= SALLY_FLAG.C;      
-    }
-    else {
-      sally_p &= ~SALLY_FLAG.C;
-    }
+    sally_c = ah > 15;
 
     sally_a = (ah << 4) | (al & 15);
   }
   else {
     pair temp;
-    temp.w = sally_a + data + (sally_p & SALLY_FLAG.C);
+    temp.w = sally_a + data + sally_c;
 
-    if(temp.b.h) {
-      sally_p |= SALLY_FLAG.C;
-    }
-    else {
-      sally_p &= ~SALLY_FLAG.C;
-    }
-        
-    if(~(sally_a ^ data) & (sally_a ^ temp.b.l) & 128) {
-      sally_p |= SALLY_FLAG.V;
-    }
-    else {
-      sally_p &= ~SALLY_FLAG.V;
-    }
+    sally_c = temp.b.h;
+    sally_v = (~(sally_a ^ data) & (sally_a ^ temp.b.l) & 128) >> 1;
         
     sally_Flags(temp.b.l);
     sally_a = temp.b.l;
@@ -435,12 +796,7 @@ sprintf( msg, "ASLA" );
 logger_LogInfo( msg );
 #endif
 
-  if(sally_a & 128) {
-    sally_p |= SALLY_FLAG.C;
-  }
-  else {
-    sally_p &= ~SALLY_FLAG.C;
-  }
+  sally_c = sally_a >> 7;
 
   sally_a <<= 1;
   sally_Flags(sally_a);
@@ -457,12 +813,7 @@ logger_LogInfo( msg );
 
   byte data = memory_Read(sally_address.w);
     
-  if(data & 128) {
-    sally_p |= SALLY_FLAG.C;
-  }
-  else {
-    sally_p &= ~SALLY_FLAG.C;
-  }
+  sally_c = data >> 7;
 
   data <<= 1;
   memory_Write(sally_address.w, data);
@@ -478,7 +829,7 @@ sprintf( msg, "BCC" );
 logger_LogInfo( msg );
 #endif
 
-  sally_Branch(!(sally_p & SALLY_FLAG.C));
+  sally_Branch(!sally_c);
 }
 
 // ----------------------------------------------------------------------------
@@ -490,7 +841,7 @@ sprintf( msg, "BCS" );
 logger_LogInfo( msg );
 #endif
 
-  sally_Branch(sally_p & SALLY_FLAG.C);
+  sally_Branch(sally_c);
 }
 
 // ----------------------------------------------------------------------------
@@ -502,7 +853,7 @@ sprintf( msg, "BEQ" );
 logger_LogInfo( msg );
 #endif
 
-  sally_Branch(sally_p & SALLY_FLAG.Z);
+  sally_Branch(!sally_z);
 }
 
 // ----------------------------------------------------------------------------
@@ -516,17 +867,9 @@ logger_LogInfo( msg );
 
   byte data = memory_Read(sally_address.w);
     
-  if(!(data & sally_a)) {
-    sally_p |= SALLY_FLAG.Z;
-  }
-  else {
-    sally_p &= ~SALLY_FLAG.Z;
-  }
-
-  sally_p &= ~SALLY_FLAG.V;
-  sally_p &= ~SALLY_FLAG.N;  
-  sally_p |= data & 64;
-  sally_p |= data & 128;
+  sally_z = data & sally_a;
+  sally_v = data;
+  sally_n = data;
 }
 
 // ----------------------------------------------------------------------------
@@ -538,7 +881,7 @@ sprintf( msg, "BMI" );
 logger_LogInfo( msg );
 #endif
 
-  sally_Branch(sally_p & SALLY_FLAG.N);
+  sally_Branch(sally_n & SALLY_FLAG.N);
 }
 
 // ----------------------------------------------------------------------------
@@ -550,7 +893,7 @@ sprintf( msg, "BNE" );
 logger_LogInfo( msg );
 #endif
 
-  sally_Branch(!(sally_p & SALLY_FLAG.Z));
+  sally_Branch(sally_z);
 }
 
 // ----------------------------------------------------------------------------
@@ -562,7 +905,7 @@ sprintf( msg, "BPL" );
 logger_LogInfo( msg );
 #endif
 
-  sally_Branch(!(sally_p & SALLY_FLAG.N));
+  sally_Branch(!(sally_n & SALLY_FLAG.N));
 }
 
 // ----------------------------------------------------------------------------
@@ -575,6 +918,7 @@ logger_LogInfo( msg );
 #endif
 
   sally_pc.w++;
+  sally_SyncFlags( );
   sally_p |= SALLY_FLAG.B;
     
   sally_Push(sally_pc.b.h);
@@ -582,8 +926,8 @@ logger_LogInfo( msg );
   sally_Push(sally_p);
 
   sally_p |= SALLY_FLAG.I;
-  sally_pc.b.l = memory_ram[SALLY_IRQ.L];
-  sally_pc.b.h = memory_ram[SALLY_IRQ.H];
+  sally_pc.b.l = memory_Peek(SALLY_IRQ.L);
+  sally_pc.b.h = memory_Peek(SALLY_IRQ.H);
 }
 
 // ----------------------------------------------------------------------------
@@ -595,7 +939,7 @@ sprintf( msg, "BVC" );
 logger_LogInfo( msg );
 #endif
 
-  sally_Branch(!(sally_p & SALLY_FLAG.V));
+  sally_Branch(!(sally_v & SALLY_FLAG.V));
 }
 
 // ----------------------------------------------------------------------------
@@ -607,7 +951,7 @@ sprintf( msg, "BVS" );
 logger_LogInfo( msg );
 #endif
 
-  sally_Branch(sally_p & SALLY_FLAG.V);
+  sally_Branch(sally_v & SALLY_FLAG.V);
 }
 
 // ----------------------------------------------------------------------------
@@ -619,7 +963,7 @@ sprintf( msg, "CLC" );
 logger_LogInfo( msg );
 #endif
 
-  sally_p &= ~SALLY_FLAG.C;
+  sally_c = 0;
 }
 
 // ----------------------------------------------------------------------------
@@ -655,7 +999,7 @@ sprintf( msg, "CLV" );
 logger_LogInfo( msg );
 #endif
 
-  sally_p &= ~SALLY_FLAG.V;
+  sally_v = 0;
 }
 
 // ----------------------------------------------------------------------------
@@ -669,13 +1013,7 @@ logger_LogInfo( msg );
 
   byte data = memory_Read(sally_address.w);
     
-  if(sally_a >= data) {
-    sally_p |= SALLY_FLAG.C;
-  }
-  else {
-    sally_p &= ~SALLY_FLAG.C;
-  }
-
+  sally_c = sally_a >= data;
   sally_Flags(sally_a - data);
 }
 
@@ -690,13 +1028,7 @@ logger_LogInfo( msg );
 
   byte data = memory_Read(sally_address.w);
     
-  if(sally_x >= data) {
-    sally_p |= SALLY_FLAG.C;  
-  }
-  else {
-    sally_p &= ~SALLY_FLAG.C;
-  }
-
+  sally_c = sally_x >= data;
   sally_Flags(sally_x - data);
 }
 
@@ -711,13 +1043,7 @@ logger_LogInfo( msg );
 
   byte data = memory_Read(sally_address.w);
 
-  if(sally_y >= data) {
-    sally_p |= SALLY_FLAG.C;
-  }
-  else {
-    sally_p &= ~SALLY_FLAG.C;
-  }
-
+  sally_c = sally_y >= data;
   sally_Flags(sally_y - data);
 }
 
@@ -892,8 +1218,7 @@ sprintf( msg, "LSRA" );
 logger_LogInfo( msg );
 #endif
 
-  sally_p &= ~SALLY_FLAG.C;
-  sally_p |= sally_a & 1;
+  sally_c = sally_a & 1;
     
   sally_a >>= 1;
   sally_Flags(sally_a);
@@ -910,8 +1235,7 @@ logger_LogInfo( msg );
 
   byte data = memory_Read(sally_address.w);
     
-  sally_p &= ~SALLY_FLAG.C;
-  sally_p |= data & 1;
+  sally_c = data & 1;
 
   data >>= 1;
   memory_Write(sally_address.w, data);
@@ -963,6 +1287,7 @@ sprintf( msg, "PHP" );
 logger_LogInfo( msg );
 #endif
 
+  sally_SyncFlags( );
   sally_Push(sally_p);
 }
 
@@ -989,6 +1314,7 @@ logger_LogInfo( msg );
 #endif
 
   sally_p = sally_Pop( );
+  sally_LoadFlags( );
 }
 
 // ----------------------------------------------------------------------------
@@ -1000,17 +1326,12 @@ sprintf( msg, "ROLA" );
 logger_LogInfo( msg );
 #endif
 
-  byte temp = sally_p;
+  byte temp = sally_c;
 
-  if(sally_a & 128) {
-    sally_p |= SALLY_FLAG.C;  
-  }
-  else {
-    sally_p &= ~SALLY_FLAG.C;
-  }
+  sally_c = sally_a >> 7;
 
   sally_a <<= 1;
-  sally_a |= temp & SALLY_FLAG.C;
+  sally_a |= temp;
   sally_Flags(sally_a);
 }
 
@@ -1024,17 +1345,12 @@ logger_LogInfo( msg );
 #endif
 
   byte data = memory_Read(sally_address.w);
-  byte temp = sally_p;
+  byte temp = sally_c;
     
-  if(data & 128) {
-    sally_p |= SALLY_FLAG.C;
-  }
-  else {
-    sally_p &= ~SALLY_FLAG.C;
-  }
+  sally_c = data >> 7;
 
   data <<= 1;
-  data |= temp & 1;
+  data |= temp;
   memory_Write(sally_address.w, data);
   sally_Flags(data);
 }
@@ -1048,13 +1364,12 @@ sprintf( msg, "RORA" );
 logger_LogInfo( msg );
 #endif
 
-  byte temp = sally_p;
+  byte temp = sally_c;
 
-  sally_p &= ~SALLY_FLAG.C;
-  sally_p |= sally_a & 1;
+  sally_c = sally_a & 1;
     
   sally_a >>= 1;
-  if(temp & SALLY_FLAG.C) {
+  if(temp) {
     sally_a |= 128;
   }
     
@@ -1071,13 +1386,12 @@ logger_LogInfo( msg );
 #endif
 
   byte data = memory_Read(sally_address.w);
-  byte temp = sally_p;
+  byte temp = sally_c;
     
-  sally_p &= ~SALLY_FLAG.C;
-  sally_p |= data & 1;
+  sally_c = data & 1;
 
   data >>= 1;
-  if(temp & 1) {
+  if(temp) {
      data |= 128;
   }
 
@@ -1095,6 +1409,7 @@ logger_LogInfo( msg );
 #endif
 
   sally_p = sally_Pop( );
+  sally_LoadFlags( );
   sally_pc.b.l = sally_Pop( );
   sally_pc.b.h = sally_Pop( );
 }
@@ -1125,7 +1440,7 @@ logger_LogInfo( msg );
   byte data = memory_Read(sally_address.w);
 
   if(sally_p & SALLY_FLAG.D) {
-    word al = (sally_a & 15) - (data & 15) - !(sally_p & SALLY_FLAG.C);
+    word al = (sally_a & 15) - (data & 15) - !sally_c;
     word ah = (sally_a >> 4) - (data >> 4);
         
     if(al > 9) {
@@ -1138,42 +1453,20 @@ logger_LogInfo( msg );
     }
     
     pair temp;
-    temp.w = sally_a - data - !(sally_p & SALLY_FLAG.C);
+    temp.w = sally_a - data - !sally_c;
 
-    if(!temp.b.h) {
-      sally_p |= SALLY_FLAG.C;
-    }
-    else {
-      sally_p &= ~SALLY_FLAG.C;
-    }
-                
-    if((sally_a ^ data) & (sally_a ^ temp.b.l) & 128) {
-      sally_p |= SALLY_FLAG.V;
-    }
-    else {
-      sally_p &= ~SALLY_FLAG.V;      
-    }
+    sally_c = !temp.b.h;
+    sally_v = ((sally_a ^ data) & (sally_a ^ temp.b.l) & 128) >> 1;
 
     sally_Flags(temp.b.l);
     sally_a = (ah << 4) | (al & 15);
   }
   else {
     pair temp;
-    temp.w = sally_a - data - !(sally_p & SALLY_FLAG.C);
+    temp.w = sally_a - data - !sally_c;
         
-    if(!temp.b.h) {
-      sally_p |= SALLY_FLAG.C;
-    }
-    else {
-      sally_p &= ~SALLY_FLAG.C;
-    }
-                
-    if((sally_a ^ data) & (sally_a ^ temp.b.l) & 128) {
-      sally_p |= SALLY_FLAG.V;
-    }
-    else {
-      sally_p &= ~SALLY_FLAG.V;
-    }
+    sally_c = !temp.b.h;
+    sally_v = ((sally_a ^ data) & (sally_a ^ temp.b.l) & 128) >> 1;
         
     sally_Flags(temp.b.l);
     sally_a = temp.b.l;
@@ -1189,7 +1482,7 @@ sprintf( msg, "SEC" );
 logger_LogInfo( msg );
 #endif
 
-  sally_p |= SALLY_FLAG.C;  
+  sally_c = 1;
 }
 
 // ----------------------------------------------------------------------------
@@ -1342,14 +1635,28 @@ logger_LogInfo( msg );
   sally_x = 0;
   sally_y = 0;
   sally_p = SALLY_FLAG.R;
+  sally_LoadFlags( );
   sally_s = 0;
   sally_pc.w = 0;
+
+  sally_idle.active = false;
+  sally_idle.pending = 0;
+  sally_idleLoops = 0;
+  sally_idleSkips = 0;
+  sally_idleCycles = 0;
+
+  sally_FlushCache( );
 }
 
 // ----------------------------------------------------------------------------
-// ExecuteInstruction
+// Execute
+// When single is set, executes one instruction and returns its cycles.
+// Otherwise the instructions are executed until the budget (in Maria cycles,
+// 4 per 6502 cycle) is used up, or a WSYNC is hit if enabled, crediting each
+// one to the RIOT timer. The return value is then in Maria cycles, half
+// cycles included.
 // ----------------------------------------------------------------------------
-uint sally_ExecuteInstruction( ) 
+static uint sally_Execute(bool single, uint budget, bool wsync)
 {
   __label__ 
 l_0x00, l_0x01, l_0x02, l_0x03, l_0x04, l_0x05, l_0x06, l_0x07, l_0x08,
@@ -1414,11 +1721,34 @@ l_0xfc, l_0xfd, l_0xfe, l_0xff;
 &&l_0xfc, &&l_0xfd, &&l_0xfe, &&l_0xff 
 };
   
+  uint total = 0;
+
+l_fetch:
   // Reset half cycle flag
   half_cycle = false;
 
+  Decoded* decoded = sally_Lookup(sally_pc);
+  if(decoded != NULL && decoded->handler != NULL && 
+     (sally_engine != SALLY_ENGINE_VERIFY || sally_VerifyDecoded(decoded, a_jump_table))) {
+    sally_operand = decoded->operand;
+    sally_cycles = decoded->cycles;
+    sally_pc.w += decoded->length;
+    goto *decoded->handler;
+  }
+
   sally_opcode = memory_Read(sally_pc.w++);
   sally_cycles = SALLY_CYCLES[sally_opcode];
+  sally_Fetch(SALLY_LENGTH[sally_opcode]);
+
+  // Instructions crossing into the next page are never cached, as that page
+  // may be remapped independently
+  if(decoded != NULL && 
+     (sally_pc.b.l >= SALLY_LENGTH[sally_opcode] || sally_pc.b.l == 0)) {
+    decoded->handler = a_jump_table[sally_opcode];
+    decoded->operand = sally_operand;
+    decoded->cycles = sally_cycles;
+    decoded->length = SALLY_LENGTH[sally_opcode];
+  }
 
 #ifdef LOWTRACE
 sprintf( msg, "Exec: %x, cycles: %d", sally_opcode, sally_cycles );
@@ -1437,97 +1767,97 @@ logger_LogDebug( message );
 //  {
     l_0x00:
       sally_BRK( ); 
-      return sally_cycles;
+      goto l_next;
 
     l_0x01:
       sally_IndirectX( ); 
       sally_ORA( ); 
-      return sally_cycles;
+      goto l_next;
     
     l_0x05:
       sally_ZeroPage( );  
       sally_ORA( ); 
-      return sally_cycles;
+      goto l_next;
 
     l_0x06: 
       sally_ZeroPage( );
       sally_ASL( );
-      return sally_cycles;
+      goto l_next;
 
     l_0x08: 
       sally_PHP( );
-      return sally_cycles;
+      goto l_next;
 
     l_0x09: 
       sally_Immediate( ); 
       sally_ORA( ); 
-      return sally_cycles;        
+      goto l_next;        
 
     l_0x0a: 
       sally_ASLA( ); 
-      return sally_cycles;        
+      goto l_next;        
 
     l_0x0d: 
       sally_Absolute( );  
       sally_ORA( ); 
-      return sally_cycles;
+      goto l_next;
 
     l_0x0e: 
       sally_Absolute( );  
       sally_ASL( ); 
-      return sally_cycles;
+      goto l_next;
 
     l_0x10: 
       sally_Relative( );
       sally_BPL( );
-      return sally_cycles;        
+      goto l_branch;        
 
     l_0x11: 
       sally_IndirectY( ); 
       sally_ORA( ); 
       sally_Delay(sally_y); 
-      return sally_cycles;
+      goto l_next;
 
     l_0x15: 
       sally_ZeroPageX( ); 
       sally_ORA( ); 
-      return sally_cycles;
+      goto l_next;
 
     l_0x16: 
       sally_ZeroPageX( ); 
       sally_ASL( ); 
-      return sally_cycles;
+      goto l_next;
 
     l_0x18: 
       sally_CLC( );
-      return sally_cycles;
+      goto l_next;
 
     l_0x19: 
       sally_AbsoluteY( ); 
       sally_ORA( ); 
       sally_Delay(sally_y); 
-      return sally_cycles;
+      goto l_next;
 
     l_0x1d: 
       sally_AbsoluteX( ); 
       sally_ORA( ); 
       sally_Delay(sally_x); 
-      return sally_cycles;
+      goto l_next;
 
     l_0x1e: 
       sally_AbsoluteX( ); 
       sally_ASL( ); 
-      return sally_cycles;
+      goto l_next;
 
     l_0x20: 
       sally_Absolute( );  
       sally_JSR( ); 
-      return sally_cycles;
+      goto l_next;
 
     l_0x21: 
       sally_IndirectX( );
       sally_AND( );
-      return sally_cycles;
+      goto l_next;
 
     l_0x24: 
       sally_ZeroPage( );
@@ -1542,657 +1872,657 @@ logger_LogDebug( message );
         half_cycle = true;
       }
 
-      return sally_cycles;
+      goto l_next;
 
     l_0x25: 
       sally_ZeroPage( );
       sally_AND( ); 
-      return sally_cycles;
+      goto l_next;
 
     l_0x26: 
       sally_ZeroPage( );
       sally_ROL( );
-      return sally_cycles;
+      goto l_next;
 
     l_0x28:
       sally_PLP( );
-      return sally_cycles;
+      goto l_next;
 
     l_0x29:
       sally_Immediate( );
       sally_AND( );
-      return sally_cycles;
+      goto l_next;
 
     l_0x2a: 
       sally_ROLA( );
-      return sally_cycles;
+      goto l_next;
 
     l_0x2c: 
       sally_Absolute( );
       sally_BIT( );
-      return sally_cycles;
+      goto l_next;
 
     l_0x2d: 
       sally_Absolute( );
       sally_AND( );
-      return sally_cycles;
+      goto l_next;
 
     l_0x2e: 
       sally_Absolute( );
       sally_ROL( );
-      return sally_cycles;
+      goto l_next;
 
     l_0x30:
       sally_Relative( );
       sally_BMI( );
-      return sally_cycles;
+      goto l_branch;
 
     l_0x31: 
       sally_IndirectY( );
       sally_AND( );
       sally_Delay(sally_y);
-      return sally_cycles;
+      goto l_next;
 
     l_0x35: 
       sally_ZeroPageX( ); 
       sally_AND( ); 
-      return sally_cycles;
+      goto l_next;
 
     l_0x36: 
       sally_ZeroPageX( ); 
       sally_ROL( ); 
-      return sally_cycles;
+      goto l_next;
 
     l_0x38: 
       sally_SEC( );
-      return sally_cycles;
+      goto l_next;
 
     l_0x39: 
       sally_AbsoluteY( );
       sally_AND( );
       sally_Delay(sally_y);
-      return sally_cycles;
+      goto l_next;
 
     l_0x3d: 
       sally_AbsoluteX( ); 
       sally_AND( );
       sally_Delay(sally_x);
-      return sally_cycles;
+      goto l_next;
 
     l_0x3e: 
       sally_AbsoluteX( );
       sally_ROL( );
-      return sally_cycles;
+      goto l_next;
 
     l_0x40: 
       sally_RTI( );
-      return sally_cycles;
+      goto l_next;
 
     l_0x41: 
       sally_IndirectX( ); 
       sally_EOR( ); 
-      return sally_cycles;
+      goto l_next;
 
     l_0x45: 
       sally_ZeroPage( );
       sally_EOR( );
-      return sally_cycles;
+      goto l_next;
 
     l_0x46: 
       sally_ZeroPage( );
       sally_LSR( );
-      return sally_cycles;
+      goto l_next;
 
     l_0x48: 
       sally_PHA( );
-      return sally_cycles;
+      goto l_next;
 
     l_0x49: 
       sally_Immediate( ); 
       sally_EOR( ); 
-      return sally_cycles;  
+      goto l_next;  
     
     l_0x4a: 
       sally_LSRA( ); 
-      return sally_cycles; 
+      goto l_next; 
     
     l_0x4c: 
       sally_Absolute( );  
       sally_JMP( ); 
-      return sally_cycles;
+      goto l_next;
 
     l_0x4d: 
       sally_Absolute( );  
       sally_EOR( ); 
-      return sally_cycles;
+      goto l_next;
 
     l_0x4e: 
       sally_Absolute( );
       sally_LSR( );
-      return sally_cycles;
+      goto l_next;
 
     l_0x50: 
       sally_Relative( );
       sally_BVC( );
-      return sally_cycles;
+      goto l_branch;
 
     l_0x51: 
       sally_IndirectY( ); 
       sally_EOR( ); 
       sally_Delay(sally_y); 
-      return sally_cycles;      
+      goto l_next;      
 
     l_0x55: 
       sally_ZeroPageX( ); 
       sally_EOR( ); 
-      return sally_cycles;
+      goto l_next;
 
     l_0x56: 
       sally_ZeroPageX( ); 
       sally_LSR( ); 
-      return sally_cycles;
+      goto l_next;
 
     l_0x58: 
       sally_CLI( );
-      return sally_cycles;
+      goto l_next;
 
     l_0x59: 
       sally_AbsoluteY( ); 
       sally_EOR( ); 
       sally_Delay(sally_y); 
-      return sally_cycles;
+      goto l_next;
 
     l_0x5d: 
       sally_AbsoluteX( ); 
       sally_EOR( ); 
       sally_Delay(sally_x); 
-      return sally_cycles;
+      goto l_next;
 
     l_0x5e: 
       sally_AbsoluteX( ); 
       sally_LSR( ); 
-      return sally_cycles;
+      goto l_next;
 
     l_0x60: 
       sally_RTS( );
-      return sally_cycles;
+      goto l_next;
 
     l_0x61: 
       sally_IndirectX( ); 
       sally_ADC( ); 
-      return sally_cycles;
+      goto l_next;
 
     l_0x65: 
       sally_ZeroPage( );
       sally_ADC( ); 
-      return sally_cycles;
+      goto l_next;
 
     l_0x66: 
       sally_ZeroPage( );  
       sally_ROR( ); 
-      return sally_cycles;
+      goto l_next;
 
     l_0x68: 
       sally_PLA( );
-      return sally_cycles;
+      goto l_next;
 
     l_0x69: 
       sally_Immediate( ); 
       sally_ADC( ); 
-      return sally_cycles;
+      goto l_next;
 
     l_0x6a: 
       sally_RORA( ); 
-      return sally_cycles;
+      goto l_next;
 
     l_0x6c: 
       sally_Indirect( );
       sally_JMP( ); 
-      return sally_cycles;
+      goto l_next;
 
     l_0x6d: 
       sally_Absolute( );
       sally_ADC( ); 
-      return sally_cycles;
+      goto l_next;
     
     l_0x6e: 
       sally_Absolute( );  
       sally_ROR( ); 
-      return sally_cycles;
+      goto l_next;
 
     l_0x70: 
       sally_Relative( );  
       sally_BVS( );
-      return sally_cycles;
+      goto l_branch;
 
     l_0x71: 
       sally_IndirectY( ); 
       sally_ADC( ); 
       sally_Delay(sally_y); 
-      return sally_cycles;
+      goto l_next;
 
     l_0x75: 
       sally_ZeroPageX( ); 
       sally_ADC( ); 
-      return sally_cycles;
+      goto l_next;
 
     l_0x76: 
       sally_ZeroPageX( ); 
       sally_ROR( ); 
-      return sally_cycles;
+      goto l_next;
 
     l_0x78: 
       sally_SEI( );
-      return sally_cycles;
+      goto l_next;
 
     l_0x79: 
       sally_AbsoluteY( ); 
       sally_ADC( ); 
       sally_Delay(sally_y); 
-      return sally_cycles;
+      goto l_next;
 
     l_0x7d: 
       sally_AbsoluteX( ); 
       sally_ADC( ); 
       sally_Delay(sally_x); 
-      return sally_cycles;
+      goto l_next;
 
     l_0x7e: 
       sally_AbsoluteX( ); 
       sally_ROR( ); 
-      return sally_cycles;
+      goto l_next;
 
     l_0x81: 
       sally_IndirectX( ); 
       sally_STA( ); 
-      return sally_cycles;
+      goto l_next;
 
     l_0x84: 
       sally_ZeroPage( );  
       sally_STY( ); 
-      return sally_cycles;
+      goto l_next;
 
     l_0x85: 
       sally_ZeroPage( );  
       sally_STA( ); 
-      return sally_cycles;
+      goto l_next;
 
     l_0x86: 
       sally_ZeroPage( );  
       sally_stx( ); 
-      return sally_cycles;
+      goto l_next;
 
     l_0x88: 
       sally_DEY( );
-      return sally_cycles;
+      goto l_next;
 
     l_0x8a: 
       sally_TXA( );
-      return sally_cycles;
+      goto l_next;
 
     l_0x8c: 
       sally_Absolute( );  
       sally_STY( ); 
-      return sally_cycles;
+      goto l_next;
 
     l_0x8d: 
       sally_Absolute( );  
       sally_STA( ); 
-      return sally_cycles;
+      goto l_next;
 
     l_0x8e: 
       sally_Absolute( );  
       sally_stx( ); 
-      return sally_cycles;
+      goto l_next;
 
     l_0x90: 
       sally_Relative( );
       sally_BCC( );
-      return sally_cycles;
+      goto l_branch;
 
     l_0x91: 
       sally_IndirectY( ); 
       sally_STA( ); 
-      return sally_cycles;
+      goto l_next;
 
     l_0x94: 
       sally_ZeroPageX( ); 
       sally_STY( ); 
-      return sally_cycles;
+      goto l_next;
 
     l_0x95: 
       sally_ZeroPageX( ); 
       sally_STA( ); 
-      return sally_cycles;
+      goto l_next;
 
     l_0x96: 
       sally_ZeroPageY( ); 
       sally_stx( ); 
-      return sally_cycles;
+      goto l_next;
 
     l_0x98: 
       sally_TYA( );
-      return sally_cycles;
+      goto l_next;
 
     l_0x99: 
       sally_AbsoluteY( ); 
       sally_STA( ); 
-      return sally_cycles;
+      goto l_next;
 
     l_0x9a: 
       sally_TXS( );
-      return sally_cycles;
+      goto l_next;
 
     l_0x9d: 
       sally_AbsoluteX( ); 
       sally_STA( ); 
-      return sally_cycles;
+      goto l_next;
 
     l_0xa0: 
       sally_Immediate( ); 
       sally_LDY( ); 
-      return sally_cycles;
+      goto l_next;
 
     l_0xa1: 
       sally_IndirectX( ); 
       sally_LDA( ); 
-      return sally_cycles;
+      goto l_next;
 
     l_0xa2: 
       sally_Immediate( ); 
       sally_LDX( ); 
-      return sally_cycles;
+      goto l_next;
 
     l_0xa4: 
       sally_ZeroPage( );  
       sally_LDY( ); 
-      return sally_cycles;
+      goto l_next;
 
     l_0xa5: 
       sally_ZeroPage( );  
       sally_LDA( ); 
-      return sally_cycles;
+      goto l_next;
 
     l_0xa6: 
       sally_ZeroPage( );  
       sally_LDX( ); 
-      return sally_cycles;
+      goto l_next;
 
     l_0xa8: 
       sally_TAY( );
-      return sally_cycles;
+      goto l_next;
 
     l_0xa9: 
       sally_Immediate( ); 
       sally_LDA( ); 
-      return sally_cycles;
+      goto l_next;
 
     l_0xaa: 
       sally_TAX( );
-      return sally_cycles;
+      goto l_next;
 
     l_0xac: 
       sally_Absolute( );  
       sally_LDY( ); 
-      return sally_cycles;
+      goto l_next;
 
     l_0xad: 
       sally_Absolute( );  
       sally_LDA( ); 
-      return sally_cycles;
+      goto l_next;
 
     l_0xae: 
       sally_Absolute( );  
       sally_LDX( ); 
-      return sally_cycles;
+      goto l_next;
 
     l_0xb0: 
       sally_Relative( );  
       sally_BCS( );
-      return sally_cycles;
+      goto l_branch;
 
     l_0xb1: 
       sally_IndirectY( ); 
       sally_LDA( ); 
       sally_Delay(sally_y); 
-      return sally_cycles;
+      goto l_next;
 
     l_0xb4: 
       sally_ZeroPageX( ); 
       sally_LDY( ); 
-      return sally_cycles;
+      goto l_next;
 
     l_0xb5: 
       sally_ZeroPageX( ); 
       sally_LDA( ); 
-      return sally_cycles;
+      goto l_next;
 
     l_0xb6: 
       sally_ZeroPageY( ); 
       sally_LDX( ); 
-      return sally_cycles;
+      goto l_next;
 
     l_0xb8: 
       sally_CLV( );
-      return sally_cycles;
+      goto l_next;
 
     l_0xb9: 
       sally_AbsoluteY( ); 
       sally_LDA( ); 
       sally_Delay(sally_y); 
-      return sally_cycles;
+      goto l_next;
 
     l_0xba: 
       sally_TSX( );
-      return sally_cycles;
+      goto l_next;
 
     l_0xbc: 
       sally_AbsoluteX( ); 
       sally_LDY( ); 
       sally_Delay(sally_x); 
-      return sally_cycles;
+      goto l_next;
 
     l_0xbd: 
       sally_AbsoluteX( ); 
       sally_LDA( ); 
       sally_Delay(sally_x);
-      return sally_cycles;
+      goto l_next;
 
     l_0xbe: 
       sally_AbsoluteY( ); 
       sally_LDX( ); 
       sally_Delay(sally_y); 
-      return sally_cycles;
+      goto l_next;
 
     l_0xc0: 
       sally_Immediate( ); 
       sally_CPY( ); 
-      return sally_cycles;
+      goto l_next;
 
     l_0xc1: 
       sally_IndirectX( ); 
       sally_CMP( ); 
-      return sally_cycles;
+      goto l_next;
 
     l_0xc4: 
       sally_ZeroPage( );  
       sally_CPY( ); 
-      return sally_cycles;
+      goto l_next;
 
     l_0xc5: 
       sally_ZeroPage( );  
       sally_CMP( ); 
-      return sally_cycles;
+      goto l_next;
 
     l_0xc6: 
       sally_ZeroPage( );  
       sally_DEC( ); 
-      return sally_cycles;
+      goto l_next;
 
     l_0xc8: 
       sally_INY( );
-      return sally_cycles;
+      goto l_next;
 
     l_0xc9: 
       sally_Immediate( ); 
       sally_CMP( ); 
-      return sally_cycles;
+      goto l_next;
 
     l_0xca: 
       sally_DEX( );
-      return sally_cycles;
+      goto l_next;
 
     l_0xcc: 
       sally_Absolute( );  
       sally_CPY( ); 
-      return sally_cycles;
+      goto l_next;
 
     l_0xcd: 
       sally_Absolute( );  
       sally_CMP( ); 
-      return sally_cycles;
+      goto l_next;
 
     l_0xce: 
       sally_Absolute( );  
       sally_DEC( ); 
-      return sally_cycles;
+      goto l_next;
 
     l_0xd0: 
       sally_Relative( );  
       sally_BNE( );
-      return sally_cycles;          
+      goto l_branch;          
 
     l_0xd1: 
       sally_IndirectY( ); 
       sally_CMP( ); 
       sally_Delay(sally_y); 
-      return sally_cycles;
+      goto l_next;
 
     l_0xd5: 
       sally_ZeroPageX( ); 
       sally_CMP( ); 
-      return sally_cycles;
+      goto l_next;
 
     l_0xd6: 
       sally_ZeroPageX( ); 
       sally_DEC( ); 
-      return sally_cycles;
+      goto l_next;
 
     l_0xd8: 
       sally_CLD( );
-      return sally_cycles;
+      goto l_next;
 
     l_0xd9: 
       sally_AbsoluteY( ); 
       sally_CMP( ); 
       sally_Delay(sally_y); 
-      return sally_cycles;
+      goto l_next;
 
     l_0xdd: 
       sally_AbsoluteX( ); 
       sally_CMP( ); 
       sally_Delay(sally_x); 
-      return sally_cycles;
+      goto l_next;
 
     l_0xde: 
       sally_AbsoluteX( ); 
       sally_DEC( ); 
-      return sally_cycles;
+      goto l_next;
 
     l_0xe0: 
       sally_Immediate( ); 
       sally_CPX( ); 
-      return sally_cycles;
+      goto l_next;
 
     l_0xe1: 
       sally_IndirectX( ); 
       sally_SBC( ); 
-      return sally_cycles;
+      goto l_next;
 
     l_0xe4: 
       sally_ZeroPage( );  
       sally_CPX( ); 
-      return sally_cycles;
+      goto l_next;
 
     l_0xe5: 
       sally_ZeroPage( );  
       sally_SBC( ); 
-      return sally_cycles;
+      goto l_next;
 
     l_0xe6: 
       sally_ZeroPage( );  
       sally_INC( ); 
-      return sally_cycles;
+      goto l_next;
 
     l_0xe8: 
       sally_INX( );
-      return sally_cycles;
+      goto l_next;
 
     l_0xe9: 
       sally_Immediate( ); 
       sally_SBC( ); 
-      return sally_cycles;
+      goto l_next;
 
     l_0xea:
       sally_NOP( );
-      return sally_cycles;
+      goto l_next;
 
     l_0xec: 
       sally_Absolute( );  
       sally_CPX( ); 
-      return sally_cycles;
+      goto l_next;
 
     l_0xed: 
       sally_Absolute( );  
       sally_SBC( ); 
-      return sally_cycles;
+      goto l_next;
 
     l_0xee: 
       sally_Absolute( );  
       sally_INC( ); 
-      return sally_cycles;
+      goto l_next;
 
     l_0xf0: 
       sally_Relative( );
       sally_BEQ( );
-      return sally_cycles;
+      goto l_branch;
 
     l_0xf1: 
       sally_IndirectY( ); 
       sally_SBC( ); 
       sally_Delay(sally_y); 
-      return sally_cycles;
+      goto l_next;
 
     l_0xf5: 
       sally_ZeroPageX( ); 
       sally_SBC( ); 
-      return sally_cycles;
+      goto l_next;
 
     l_0xf6: 
       sally_ZeroPageX( ); 
       sally_INC( ); 
-      return sally_cycles;
+      goto l_next;
 
     l_0xf8: 
       sally_SED( );
-      return sally_cycles;
+      goto l_next;
 
     l_0xf9: 
       sally_AbsoluteY( ); 
       sally_SBC( ); 
       sally_Delay(sally_y); 
-      return sally_cycles;
+      goto l_next;
 
     l_0xfd: 
       sally_AbsoluteX( ); 
       sally_SBC( ); 
       sally_Delay(sally_x); 
-      return sally_cycles;
+      goto l_next;
 
     l_0xfe: 
       sally_AbsoluteX( ); 
       sally_INC( ); 
-      return sally_cycles;
+      goto l_next;
 l_0xff:
 l_0xfc:
 l_0xfb:
@@ -2298,10 +2628,68 @@ l_0x07:
 l_0x04:
 l_0x03:
 l_0x02:
-      return sally_cycles;
+      goto l_next;
   //}
 
-  return sally_cycles;
+l_branch:
+  // A taken backward branch may close an idle loop
+  if(!single && sally_cycles > 2 && (signed char)sally_address.b.l < 0) {
+    total += sally_Idle(total, budget);
+  }
+
+l_next:
+  if(single) {
+    return sally_cycles;
+  }
+  total += sally_cycles << 2;
+  if(half_cycle) {
+    total += 2;
+  }
+  riot_UpdateTimer(sally_cycles);
+  if(total < budget && !(wsync && memory_ram[WSYNC])) {
+    goto l_fetch;
+  }
+  return total;
+}
+
+// ----------------------------------------------------------------------------
+// ExecuteInstruction
+// ----------------------------------------------------------------------------
+uint sally_ExecuteInstruction( ) {
+  return sally_Execute(true, 0, false);
+}
+
+// ----------------------------------------------------------------------------
+// Run
+// Executes instructions until the budget (in Maria cycles) is used up, or a
+// WSYNC is hit when wsync is set (WSYNC is left set for the caller). The RIOT
+// timer is credited as the instructions execute. Returns the Maria cycles
+// executed, including half cycles. With the run engine the instructions are
+// dispatched back-to-back and idle loops are fast-forwarded; the verify
+// engine does the same but checks the decode cache and executes the skipped
+// iterations; the interpreter engine returns to this loop after every
+// instruction.
+// ----------------------------------------------------------------------------
+uint sally_Run(uint budget, bool wsync) {
+  // A skip always ends before the budget, so its iterations all ran
+  sally_VerifyIdle(false);
+  // Memory may have changed since the last run (Maria, NMI)
+  sally_idle.active = false;
+
+  if(sally_engine != SALLY_ENGINE_INTERPRETER) {
+    return sally_Execute(false, budget, wsync);
+  }
+
+  uint total = 0;
+  do {
+    uint cycles = sally_Execute(true, 0, false);
+    total += cycles << 2;
+    if(half_cycle) {
+      total += 2;
+    }
+    riot_UpdateTimer(cycles);
+  } while(total < budget && !(wsync && memory_ram[WSYNC]));
+  return total;
 }
 
 // ----------------------------------------------------------------------------
@@ -2309,8 +2697,9 @@ l_0x02:
 // ----------------------------------------------------------------------------
 uint sally_ExecuteRES( ) {
   sally_p = SALLY_FLAG.I | SALLY_FLAG.R | SALLY_FLAG.Z;
-  sally_pc.b.l = memory_ram[SALLY_RES.L];
-  sally_pc.b.h = memory_ram[SALLY_RES.H];
+  sally_LoadFlags( );
+  sally_pc.b.l = memory_Peek(SALLY_RES.L);
+  sally_pc.b.h = memory_Peek(SALLY_RES.H);
   return 6;
 }
 
@@ -2320,11 +2709,12 @@ uint sally_ExecuteRES( ) {
 uint sally_ExecuteNMI( ) {
   sally_Push(sally_pc.b.h);
   sally_Push(sally_pc.b.l);
+  sally_SyncFlags( );
   sally_p &= ~SALLY_FLAG.B;
   sally_Push(sally_p);
   sally_p |= SALLY_FLAG.I;
-  sally_pc.b.l = memory_ram[SALLY_NMI.L];
-  sally_pc.b.h = memory_ram[SALLY_NMI.H];
+  sally_pc.b.l = memory_Peek(SALLY_NMI.L);
+  sally_pc.b.h = memory_Peek(SALLY_NMI.H);
   return 7;
 }
 
@@ -2335,11 +2725,12 @@ uint sally_ExecuteIRQ( ) {
   if(!(sally_p & SALLY_FLAG.I)) {
     sally_Push(sally_pc.b.h);
     sally_Push(sally_pc.b.l);
+    sally_SyncFlags( );
     sally_p &= ~SALLY_FLAG.B;
     sally_Push(sally_p);
     sally_p |= SALLY_FLAG.I;
-    sally_pc.b.l = memory_ram[SALLY_IRQ.L];
-    sally_pc.b.h = memory_ram[SALLY_IRQ.H];
+    sally_pc.b.l = memory_Peek(SALLY_IRQ.L);
+    sally_pc.b.h = memory_Peek(SALLY_IRQ.H);
   }
   return 7;
 }
@@ -25,6 +25,10 @@
 #ifndef SALLY_H
 #define SALLY_H
 
+#define SALLY_ENGINE_INTERPRETER 0
+#define SALLY_ENGINE_RUN 1
+#define SALLY_ENGINE_VERIFY 2
+
 #include "Memory.h"
 #include "Pair.h"
 
@@ -33,7 +37,11 @@ typedef unsigned short word;
 typedef unsigned int uint;
 
 extern void sally_Reset( );
+extern void sally_FlushCache( );
+extern void sally_SyncFlags( );
+extern void sally_LoadFlags( );
 extern uint sally_ExecuteInstruction( );
+extern uint sally_Run(uint budget, bool wsync);
 extern uint sally_ExecuteRES( );
 extern uint sally_ExecuteNMI( );
 extern uint sally_ExecuteIRQ( );
@@ -43,5 +51,19 @@ extern byte sally_y;
 extern byte sally_p;
 extern byte sally_s;
 extern pair sally_pc;
+// Note: the N, Z, C and V bits of sally_p are only current after a call to
+// sally_SyncFlags, and sally_LoadFlags must be called after sally_p is set
+
+// The execution engine used by sally_Run: one instruction at a time,
+// back-to-back with idle loops fast-forwarded, or back-to-back with each
+// cached decode and idle loop skip checked against the uncached interpreter
+extern byte sally_engine;
+// The cached decodes and idle loop skips that did not match (verify engine)
+extern uint sally_verifyErrors;
+// Idle loops detected, the number of times they were fast-forwarded and the
+// cycles skipped (run engine)
+extern uint sally_idleLoops;
+extern uint sally_idleSkips;
+extern uint sally_idleCycles;
 
 #endif
@@ -24,6 +24,7 @@
 // ----------------------------------------------------------------------------
 #include "Sound.h"
 #include "ProSystem.h"
+#include <math.h>
 #include <SDL.h>
 #include "wii_direct_sound.h"
 
@@ -32,7 +33,23 @@
 int wii_sound_length = 0;
 int wii_convert_length = 0;
 
-#define MAX_BUFFER_SIZE 8192
+// Resampling filter: fractional positions and taps per position
+#define SOUND_FIR_PHASE_BITS 5
+#define SOUND_FIR_PHASES (1 << SOUND_FIR_PHASE_BITS)
+#define SOUND_FIR_TAPS 8
+#define SOUND_FIR_SHIFT 14
+// Source samples carried over from the previous frame for the filter
+#define SOUND_FIR_HISTORY (SOUND_FIR_TAPS - 1)
+// Filter cutoff as a fraction of the source sample rate
+#define SOUND_FIR_CUTOFF 0.45
+
+// Frames kept queued ahead of the audio output
+#define SOUND_QUEUE_TARGET 2048
+// Largest adjustment of the output rate (0.5%)
+#define SOUND_MAX_RATE_DELTA 0.005
+
+// Register writes a frame can log before it is synthesized early
+#define SOUND_LOG_SIZE 4096
 
 /* LUDO: */
 typedef unsigned short WORD;
@@ -52,27 +69,114 @@ typedef struct {
 static const WAVEFORMATEX SOUND_DEFAULT_FORMAT = {WAVE_FORMAT_PCM, 1, 48000, 48000, 1, 8, 0};
 static WAVEFORMATEX sound_format = SOUND_DEFAULT_FORMAT;
 static bool sound_muted = false;
+static double sound_lengthRemainder = 0;
+
+static short sound_filter[SOUND_FIR_PHASES][SOUND_FIR_TAPS];
+static short sound_mix[SOUND_FIR_HISTORY + TIA_BUFFER_SIZE];
+static uint32_t sound_silence[1024];
+
+typedef struct {
+  word sample;
+  word address;
+  byte data;
+} SoundWrite;
 
-static void wii_storeSound( byte* sample, int length )
-{
-  SDL_AudioCVT audio_convert;
-  SDL_BuildAudioCVT(
-    &audio_convert,
-    AUDIO_U8,
-    1,
-    48000,
-    AUDIO_S16MSB, 
-    2,
-    48000
-    );
+// A frame of TIA and POKEY register writes, stamped with the sample they
+// were made at, and how far the frame's sound has been clocked and
+// synthesized.
+typedef struct {
+  SoundWrite log[SOUND_LOG_SIZE];
+  uint logSize;
+  uint position;
+  uint rendered;
+  bool pokey;
+  bool store;
+} SoundFrame;
+
+typedef void (*SoundResampler)(const SoundFrame& frame, uint length);
+static SoundResampler sound_resampler;
+
+// The emulation thread logs into one frame while the audio thread
+// synthesizes the other, they trade frames through the semaphores.
+static SoundFrame sound_frames[2];
+static SoundFrame* sound_frame = sound_frames;
+static SoundFrame* volatile sound_pending = NULL;
+static SDL_Thread* sound_thread = NULL;
+static SDL_sem* sound_frameReady = NULL;
+static SDL_sem* sound_frameDone = NULL;
+static volatile bool sound_quit = false;
+// Output frames of the frame handed to the audio thread that are not in the
+// output queue yet
+static volatile uint sound_pendingLength = 0;
+
+// ----------------------------------------------------------------------------
+// GetLevel
+// ----------------------------------------------------------------------------
+// Signed 16 bit level of an unsigned 8 bit mix, as the SDL U8 to S16
+// conversion used to produce it.
+static inline short sound_GetLevel(uint value) {
+  return (short)(((int)value - 128) << 8);
+}
+
+// ----------------------------------------------------------------------------
+// GetFrame
+// ----------------------------------------------------------------------------
+// Stereo frame with the same level on both channels, in the byte order of
+// the output.
+template<bool swapped>
+static inline uint32_t sound_GetFrame(short level) {
+  word value = (word)level;
+  if(swapped) {
+    value = (word)((value >> 8) | (value << 8));
+  }
+  return ((uint32_t)value << 16) | value;
+}
 
-  audio_convert.buf = sample;
-  audio_convert.len = length;
-  SDL_ConvertAudio( &audio_convert );
-  PlaySound( (u32*)sample, ( audio_convert.len_cvt / 4 ) );        
+// ----------------------------------------------------------------------------
+// InitFilter
+// ----------------------------------------------------------------------------
+// Builds the polyphase interpolation filter, a Blackman windowed sinc with
+// each phase normalized to unity gain in fixed point.
+static void sound_InitFilter( ) {
+  const double half = SOUND_FIR_TAPS / 2.0;
+  for(int phase = 0; phase < SOUND_FIR_PHASES; phase++) {
+    double fraction = (double)phase / SOUND_FIR_PHASES;
+    double taps[SOUND_FIR_TAPS];
+    double sum = 0;
+    for(int tap = 0; tap < SOUND_FIR_TAPS; tap++) {
+      double x = tap - (half - 1) - fraction;
+      double sinc = (x == 0)? 1.0: sin(M_PI * 2 * SOUND_FIR_CUTOFF * x) / (M_PI * 2 * SOUND_FIR_CUTOFF * x);
+      double window = 0.42 + 0.5 * cos(M_PI * x / half) + 0.08 * cos(2 * M_PI * x / half);
+      taps[tap] = sinc * window;
+      sum += taps[tap];
+    }
+    int total = 0;
+    for(int tap = 0; tap < SOUND_FIR_TAPS; tap++) {
+      sound_filter[phase][tap] = (short)floor(taps[tap] / sum * (1 << SOUND_FIR_SHIFT) + 0.5);
+      total += sound_filter[phase][tap];
+    }
+    // Put the rounding error on the largest tap so DC passes unchanged
+    sound_filter[phase][SOUND_FIR_TAPS / 2 - 1 + (fraction >= 0.5)] += (1 << SOUND_FIR_SHIFT) - total;
+  }
+}
 
-  wii_sound_length = length;
-  wii_convert_length = audio_convert.len_cvt;
+// ----------------------------------------------------------------------------
+// Mix
+// ----------------------------------------------------------------------------
+// Mixes the TIA and POKEY output of the frame into 16 bit levels behind the
+// samples kept from the previous frame.
+static void sound_Mix(uint length, bool pokey) {
+  short* target = sound_mix + SOUND_FIR_HISTORY;
+  if(pokey) {
+    for(uint index = 0; index < length; index++) {
+      target[index] = sound_GetLevel((tia_buffer[index] + pokey_buffer[index]) >> 1);
+    }
+  }
+  else {
+    for(uint index = 0; index < length; index++) {
+      target[index] = sound_GetLevel(tia_buffer[index]);
+    }
+  }
 }
 
 // ----------------------------------------------------------------------------
@@ -87,36 +191,272 @@ static uint sound_GetSampleLength(uint length, uint unit, uint unitMax) {
   return sampleLength;
 }
 
+// ----------------------------------------------------------------------------
+// GetFrameLength
+// ----------------------------------------------------------------------------
+// Number of output samples for the current frame. The nominal rate is
+// stretched or shrunk by up to SOUND_MAX_RATE_DELTA depending on how far the
+// output queue is from its target, so the queue neither drains nor fills up
+// when the emulated and the real frame rates differ slightly.
+static uint sound_GetFrameLength( ) {
+  double delta = SOUND_MAX_RATE_DELTA *
+    ( (double)SOUND_QUEUE_TARGET - GetAudioQueued( ) ) / SOUND_QUEUE_TARGET;
+  if(delta > SOUND_MAX_RATE_DELTA) {
+    delta = SOUND_MAX_RATE_DELTA;
+  }
+  else if(delta < -SOUND_MAX_RATE_DELTA) {
+    delta = -SOUND_MAX_RATE_DELTA;
+  }
+
+  double length = ( 48000.0 / prosystem_frequency ) * ( 1.0 + delta ) +
+    sound_lengthRemainder;
+  uint sampleLength = (uint)length;
+  sound_lengthRemainder = length - sampleLength;
+  return sampleLength;
+}
+
 // ----------------------------------------------------------------------------
 // Resample
 // ----------------------------------------------------------------------------
-static void sound_Resample(const byte* source, byte* target, int length) {
-  int measurement = sound_format.nSamplesPerSec;
-  int sourceIndex = 0;
-  int targetIndex = 0;
-  
-  int max = ( ( prosystem_frequency * prosystem_scanlines ) << 1 );
-  while(targetIndex < length) {
-    if(measurement >= max) {
-      target[targetIndex++] = source[sourceIndex];
-      measurement -= max;
+// Mixes the frame's source samples and interpolates them over length stereo
+// output frames. The source position is 16.16 fixed point, stepped so that
+// the frame's samples are covered exactly; the top bits of the fraction
+// select the filter phase. The filter runs a few source samples behind, so
+// it only reaches back into the history and never past the frame. Frames
+// are written straight into the output ring in its final format.
+template<bool swapped>
+static void sound_Resample(const SoundFrame& frame, uint length) {
+  uint sourceLength = frame.position;
+  sound_Mix(sourceLength, frame.pokey);
+
+  audio_ring* ring = GetSoundRing( );
+  uint count = audio_ring_reserve(ring, length);
+
+  uint step = (sourceLength << 16) / length;
+  uint stepRemainder = (sourceLength << 16) % length;
+  uint error = 0;
+  uint position = 0;
+  for(uint index = 0; index < count; index++) {
+    const short* source = sound_mix + (position >> 16);
+    const short* filter = sound_filter[(position >> (16 - SOUND_FIR_PHASE_BITS)) & (SOUND_FIR_PHASES - 1)];
+    int sample = 
+      filter[0] * source[0] + filter[1] * source[1] +
+      filter[2] * source[2] + filter[3] * source[3] +
+      filter[4] * source[4] + filter[5] * source[5] +
+      filter[6] * source[6] + filter[7] * source[7];
+    sample >>= SOUND_FIR_SHIFT;
+    if(sample > 32767) {
+      sample = 32767;
+    }
+    else if(sample < -32768) {
+      sample = -32768;
+    }
+    audio_ring_put(ring, index, sound_GetFrame<swapped>((short)sample));
+
+    position += step;
+    error += stepRemainder;
+    if(error >= length) {
+      error -= length;
+      position++;
+    }
+  }
+
+  CommitSound(count);
+
+  for(uint index = 0; index < SOUND_FIR_HISTORY; index++) {
+    sound_mix[index] = sound_mix[sourceLength + index];
+  }
+}
+
+// ----------------------------------------------------------------------------
+// Synthesize
+// ----------------------------------------------------------------------------
+// Synthesizes the frame's sound up to the given sample.
+static void sound_Synthesize(SoundFrame& frame, uint sample) {
+  uint length = sample - frame.rendered;
+  tia_Process(length);
+  if(frame.pokey) {
+    pokey_Process(length);
+  }
+  frame.rendered = sample;
+}
+
+// ----------------------------------------------------------------------------
+// Render
+// ----------------------------------------------------------------------------
+// Synthesizes everything clocked so far, applying the logged register writes
+// at the samples they were made at.
+static void sound_Render(SoundFrame& frame) {
+  for(uint index = 0; index < frame.logSize; index++) {
+    const SoundWrite& write = frame.log[index];
+    sound_Synthesize(frame, write.sample);
+    if(write.address >= POKEY_AUDF1) {
+      pokey_WriteRegister(write.address, write.data);
     }
     else {
-      sourceIndex++;
-      measurement += sound_format.nSamplesPerSec;
+      tia_WriteRegister(write.address, write.data);
+    }
+  }
+  frame.logSize = 0;
+  sound_Synthesize(frame, frame.position);
+}
+
+// ----------------------------------------------------------------------------
+// Complete
+// ----------------------------------------------------------------------------
+// Renders the rest of a finished frame and, if it is to be heard, resamples
+// it into the output.
+static void sound_Complete(SoundFrame& frame) {
+  sound_Render(frame);
+  if(frame.store) {
+    uint length = sound_GetFrameLength( );
+    sound_resampler(frame, length);
+    sound_pendingLength = 0;
+
+    wii_sound_length = length;
+    wii_convert_length = length << 2;
+  }
+}
+
+// ----------------------------------------------------------------------------
+// Run
+// ----------------------------------------------------------------------------
+// Audio thread, completes each frame handed over while the emulation thread
+// runs the next one.
+static int sound_Run(void* data) {
+  while(true) {
+    SDL_SemWait(sound_frameReady);
+    if(sound_quit) {
+      break;
     }
+    sound_Complete(*sound_pending);
+    SDL_SemPost(sound_frameDone);
+  }
+  return 0;
+}
+
+// ----------------------------------------------------------------------------
+// Sync
+// ----------------------------------------------------------------------------
+// Waits for the audio thread to finish the frame it was handed, after which
+// the sound state and the output ring can be used from this thread.
+static void sound_Sync( ) {
+  if(sound_thread != NULL) {
+    SDL_SemWait(sound_frameDone);
+    SDL_SemPost(sound_frameDone);
+  }
+}
+
+// ----------------------------------------------------------------------------
+// Submit
+// ----------------------------------------------------------------------------
+// Ends the frame being logged and starts logging into the other one. The
+// frame is completed by the audio thread once it is done with the previous
+// one, or right away when there is no audio thread; the writes are replayed
+// the same either way.
+static void sound_Submit(bool store) {
+  SoundFrame& frame = *sound_frame;
+  frame.pokey = cartridge_pokey;
+  frame.store = store;
+  if(sound_thread != NULL) {
+    SDL_SemWait(sound_frameDone);
+    sound_pendingLength = (store)? 48000 / prosystem_frequency: 0;
+    sound_pending = &frame;
+    SDL_SemPost(sound_frameReady);
+  }
+  else {
+    sound_Complete(frame);
   }
+
+  sound_frame = (sound_frame == sound_frames)? sound_frames + 1: sound_frames;
+  sound_frame->logSize = 0;
+  sound_frame->position = 0;
+  sound_frame->rendered = 0;
 }
 
+// ----------------------------------------------------------------------------
+// Log
+// ----------------------------------------------------------------------------
+// Records a TIA or POKEY sound register write at the current sample. Only
+// the emulation thread touches the frame being logged. Should the log fill
+// up, the audio thread is let finish the previous frame and what has been
+// logged is synthesized here instead, in the same order.
+void sound_Log(word address, byte data) {
+  SoundFrame& frame = *sound_frame;
+  if(frame.logSize == SOUND_LOG_SIZE) {
+    sound_Sync( );
+    frame.pokey = cartridge_pokey;
+    sound_Render(frame);
+  }
+  SoundWrite& write = frame.log[frame.logSize++];
+  write.sample = frame.position;
+  write.address = address;
+  write.data = data;
+}
+
+// ----------------------------------------------------------------------------
+// Clock
+// ----------------------------------------------------------------------------
+// Advances the frame's sound clock by length samples.
+void sound_Clock(uint length) {
+  sound_frame->position += length;
+}
+
+// ----------------------------------------------------------------------------
+// Reset
+// ----------------------------------------------------------------------------
+// Waits for the audio thread and drops the frame being logged, before the
+// sound state is reset or the cartridge changed.
+void sound_Reset( ) {
+  sound_Sync( );
+  sound_frame->logSize = 0;
+  sound_frame->position = 0;
+  sound_frame->rendered = 0;
+}
 
 // ----------------------------------------------------------------------------
 // Initialize
 // ----------------------------------------------------------------------------
 bool sound_Initialize() {
   InitialiseAudio();
+
+  // The output format is fixed once the audio is open
+  bool swapped = (GetAudioFormat( ) == AUDIO_FORMAT_S16_SWAPPED);
+  sound_resampler = (swapped)? sound_Resample<true>: sound_Resample<false>;
+  uint32_t silence = (swapped)? 
+    sound_GetFrame<true>(sound_GetLevel(0)): sound_GetFrame<false>(sound_GetLevel(0));
+  for(uint index = 0; index < 1024; index++) {
+    sound_silence[index] = silence;
+  }
+
+  sound_InitFilter( );
+  for(uint index = 0; index < SOUND_FIR_HISTORY; index++) {
+    sound_mix[index] = sound_GetLevel(0);
+  }
+
+  // Without the audio thread frames are completed on the emulation thread
+  sound_frameReady = SDL_CreateSemaphore(0);
+  sound_frameDone = SDL_CreateSemaphore(1);
+  if(sound_frameReady != NULL && sound_frameDone != NULL) {
+    sound_thread = SDL_CreateThread(sound_Run, NULL);
+  }
   return true;
 }
 
+// ----------------------------------------------------------------------------
+// Release
+// ----------------------------------------------------------------------------
+// Stops the audio thread once it has finished the frame it was handed.
+void sound_Release( ) {
+  if(sound_thread != NULL) {
+    sound_Sync( );
+    sound_quit = true;
+    SDL_SemPost(sound_frameReady);
+    SDL_WaitThread(sound_thread, NULL);
+    sound_thread = NULL;
+  }
+}
+
 // ----------------------------------------------------------------------------
 // SetFormat
 // ----------------------------------------------------------------------------
@@ -128,38 +468,53 @@ bool sound_SetFormat(WAVEFORMATEX format) {
 // ----------------------------------------------------------------------------
 // Store
 // ----------------------------------------------------------------------------
-
+// Ends the frame and queues its sound for output.
 bool sound_Store( ) {
 
   if( sound_muted ) sound_SetMuted( false );
 
-  byte sample[MAX_BUFFER_SIZE];
-  memset( sample, 0, MAX_BUFFER_SIZE );  
-  uint length = 48000 / prosystem_frequency; /* sound_GetSampleLength(sound_format.nSamplesPerSec, prosystem_frame, prosystem_frequency); */ /* 48000 / prosystem_frequency */
-  sound_Resample(tia_buffer, sample, length);
-  
-  if(cartridge_pokey) {
-    byte pokeySample[MAX_BUFFER_SIZE];
-    memset( pokeySample, 0, MAX_BUFFER_SIZE );
-    sound_Resample(pokey_buffer, pokeySample, length);
-    for(uint index = 0; index < length; index++) {
-      sample[index] += pokeySample[index];
-      sample[index] = sample[index] / 2;
-    }
-  }  
-
-  wii_storeSound( sample, length );  
-     
+  sound_Submit( true );
   return true;
 }
 
+// ----------------------------------------------------------------------------
+// Flush
+// ----------------------------------------------------------------------------
+// Ends a frame that is not heard. Its sound is still synthesized, so the
+// following frames sound the same as if it had been.
+void sound_Flush( ) {
+  sound_Submit( false );
+}
+
+// ----------------------------------------------------------------------------
+// Wait
+// ----------------------------------------------------------------------------
+// Blocks until the audio output has drained to its target fill, which paces
+// emulation by the 48kHz output clock. Returns false without waiting when
+// sound is not being played, the caller then paces by the frame timer.
+bool sound_Wait( ) {
+  if(sound_muted) {
+    return false;
+  }
+  return WaitAudio(SOUND_QUEUE_TARGET) != 0;
+}
+
+// ----------------------------------------------------------------------------
+// IsLate
+// Whether the output queue has drained below its target, the emulation is
+// falling behind the audio clock. The frame the audio thread may not have
+// queued yet is counted as queued.
+// ----------------------------------------------------------------------------
+bool sound_IsLate( ) {
+  return GetAudioQueued( ) + sound_pendingLength < SOUND_QUEUE_TARGET;
+}
+
 // ----------------------------------------------------------------------------
 // Play
 // ----------------------------------------------------------------------------
 bool sound_Play( ) {
-  byte sample[MAX_BUFFER_SIZE];
-  memset( sample, 0, MAX_BUFFER_SIZE );
-  wii_storeSound( sample, 1024 );
+  sound_Sync( );
+  PlaySound( sound_silence, 1024 );
   //ResetAudio();
   return true;
 }
@@ -168,9 +523,8 @@ bool sound_Play( ) {
 // Stop
 // ----------------------------------------------------------------------------
 bool sound_Stop( ) {
-  byte sample[MAX_BUFFER_SIZE];
-  memset( sample, 0, MAX_BUFFER_SIZE );
-  wii_storeSound( sample, 1024 );
+  sound_Sync( );
+  PlaySound( sound_silence, 1024 );
   //StopAudio();
   return true;
 }
@@ -36,11 +36,18 @@ typedef unsigned char byte;
 typedef unsigned short word;
 typedef unsigned int uint;
 
+extern void sound_Log(word address, byte data);
+extern void sound_Clock(uint length);
 extern bool sound_Store( );
+extern void sound_Flush( );
+extern void sound_Reset( );
+extern bool sound_Wait( );
+extern bool sound_IsLate( );
 extern bool sound_CheckTimer();
 extern bool sound_Play( );
 extern bool sound_SetSampleRate(uint rate);
 extern bool sound_Initialize();
+extern void sound_Release( );
 extern bool sound_SetMuted(bool muted);
 
 extern int wii_sound_length;
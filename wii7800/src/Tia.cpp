@@ -39,6 +39,7 @@
 // Tia.cpp
 // ----------------------------------------------------------------------------
 #include "Tia.h"
+#include "Sound.h"
 #define TIA_POLY4_SIZE 15
 #define TIA_POLY5_SIZE 31
 #define TIA_POLY9_SIZE 511
@@ -61,73 +62,126 @@ static uint tia_poly5Cntr[2] = {0};
 static uint tia_poly9Cntr[2] = {0};
 static uint tia_soundCntr = 0;
 
+typedef void (*TiaRenderer)(byte channel, byte* target, uint length);
+
 // ----------------------------------------------------------------------------
 // ProcessChannel
 // ----------------------------------------------------------------------------
-static void tia_ProcessChannel(byte channel) {
+// Clocks the channel's poly counters and returns its new volume. The control
+// register is a template argument so only the selected waveform is tested.
+template<byte audc>
+static inline byte tia_ProcessChannel(byte channel, byte volume) {
   tia_poly5Cntr[channel]++;
   if(tia_poly5Cntr[channel] == TIA_POLY5_SIZE) {
     tia_poly5Cntr[channel] = 0;
   }
-  if(((tia_audc[channel] & 2) == 0) || (((tia_audc[channel] & 1) == 0) && TIA_DIV31[tia_poly5Cntr[channel]]) || (((tia_audc[channel] & 1) == 1) && TIA_POLY5[tia_poly5Cntr[channel]])) {
-    if(tia_audc[channel] & 4) {
-      tia_volume[channel] = (!tia_volume[channel])? tia_audv[channel]: 0;
+  if((audc & 2) == 0 || ((audc & 1) == 0 && TIA_DIV31[tia_poly5Cntr[channel]]) || ((audc & 1) == 1 && TIA_POLY5[tia_poly5Cntr[channel]])) {
+    if(audc & 4) {
+      return (!volume)? tia_audv[channel]: 0;
     }
-    else if(tia_audc[channel] & 8) {
-      if(tia_audc[channel] == 8) {
+    else if(audc & 8) {
+      if(audc == 8) {
         tia_poly9Cntr[channel]++;
         if(tia_poly9Cntr[channel] == TIA_POLY9_SIZE) {
           tia_poly9Cntr[channel] = 0;
         }
-        tia_volume[channel] = (TIA_POLY9[tia_poly9Cntr[channel]])? tia_audv[channel]: 0;
-      }
-      else {
-        tia_volume[channel] = (TIA_POLY5[tia_poly5Cntr[channel]])? tia_audv[channel]: 0;
+        return (TIA_POLY9[tia_poly9Cntr[channel]])? tia_audv[channel]: 0;
       }
+      return (TIA_POLY5[tia_poly5Cntr[channel]])? tia_audv[channel]: 0;
     }
-    else {
-      tia_poly4Cntr[channel]++;
-      if(tia_poly4Cntr[channel] == TIA_POLY4_SIZE) {
-        tia_poly4Cntr[channel] = 0;
-      }
-      tia_volume[channel] = (TIA_POLY4[tia_poly4Cntr[channel]])? tia_audv[channel]: 0;
+    tia_poly4Cntr[channel]++;
+    if(tia_poly4Cntr[channel] == TIA_POLY4_SIZE) {
+      tia_poly4Cntr[channel] = 0;
     }
+    return (TIA_POLY4[tia_poly4Cntr[channel]])? tia_audv[channel]: 0;
   }
+  return volume;
 }
 
+// ----------------------------------------------------------------------------
+// Fill
+// ----------------------------------------------------------------------------
+template<bool mix>
+static inline void tia_Fill(byte* target, uint length, byte volume) {
+  for(uint index = 0; index < length; index++) {
+    target[index] = (mix)? target[index] + volume: volume;
+  }
+}
 
 // ----------------------------------------------------------------------------
-// Reset
+// RenderChannel
 // ----------------------------------------------------------------------------
-void tia_Reset( ) {
-  tia_soundCntr = 0;
-  for(int index = 0; index < 2; index++) {
-    tia_volume[index] = 0;
-    tia_counterMax[index] = 0;
-    tia_counter[index] = 0;
-    tia_audc[index] = 0;
-    tia_audf[index] = 0;
-    tia_audv[index] = 0;
-    tia_poly4Cntr[index] = 0;
-    tia_poly5Cntr[index] = 0;
-    tia_poly9Cntr[index] = 0;
+// Writes (or with mix, adds) length samples of a single channel. The volume
+// only changes when the divider expires, so the samples in between are
+// written as constant runs.
+template<byte audc, bool mix>
+static void tia_RenderChannel(byte channel, byte* target, uint length) {
+  uint counter = tia_counter[channel];
+  uint counterMax = tia_counterMax[channel];
+  byte volume = tia_volume[channel];
+
+  while(length != 0) {
+    if(counter == 0 || counter > length) {
+      tia_Fill<mix>(target, length, volume);
+      if(counter != 0) {
+        counter -= length;
+      }
+      break;
+    }
+    uint run = counter - 1;
+    tia_Fill<mix>(target, run, volume);
+    target += run;
+    length -= run;
+    volume = tia_ProcessChannel<audc>(channel, volume);
+    counter = counterMax;
+    tia_Fill<mix>(target++, 1, volume);
+    length--;
   }
-  tia_Clear( );
+
+  tia_counter[channel] = counter;
+  tia_volume[channel] = volume;
 }
 
+#define TIA_RENDERERS(mix) { \
+  tia_RenderChannel<0, mix>, tia_RenderChannel<1, mix>, \
+  tia_RenderChannel<2, mix>, tia_RenderChannel<3, mix>, \
+  tia_RenderChannel<4, mix>, tia_RenderChannel<5, mix>, \
+  tia_RenderChannel<6, mix>, tia_RenderChannel<7, mix>, \
+  tia_RenderChannel<8, mix>, tia_RenderChannel<9, mix>, \
+  tia_RenderChannel<10, mix>, tia_RenderChannel<11, mix>, \
+  tia_RenderChannel<12, mix>, tia_RenderChannel<13, mix>, \
+  tia_RenderChannel<14, mix>, tia_RenderChannel<15, mix> }
+
+static const TiaRenderer TIA_WRITERS[16] = TIA_RENDERERS(false);
+static const TiaRenderer TIA_MIXERS[16] = TIA_RENDERERS(true);
+
 // ----------------------------------------------------------------------------
-// Clear
+// Process
 // ----------------------------------------------------------------------------
-void tia_Clear( ) {
-  for(int index = 0; index < TIA_BUFFER_SIZE; index++) {
-    tia_buffer[index] = 0;
+// Renders length samples at the current register state, channel 0 first and
+// channel 1 mixed on top, wrapping at the end of the frame buffer.
+void tia_Process(uint length) {
+  while(length != 0) {
+    uint span = tia_size - tia_soundCntr;
+    if(span > length) {
+      span = length;
+    }
+    byte* target = tia_buffer + tia_soundCntr;
+    TIA_WRITERS[tia_audc[0]](0, target, span);
+    TIA_MIXERS[tia_audc[1]](1, target, span);
+    tia_soundCntr += span;
+    if(tia_soundCntr >= tia_size) {
+      tia_soundCntr = 0;
+    }
+    length -= span;
   }
 }
 
 // ----------------------------------------------------------------------------
-// SetRegister
+// WriteRegister
 // ----------------------------------------------------------------------------
-void tia_SetRegister(word address, byte data) {
+// Applies a logged write to the sound state, on the thread synthesizing it.
+void tia_WriteRegister(word address, byte data) {
   byte channel;
   byte frequency;
     
@@ -179,28 +233,52 @@ void tia_SetRegister(word address, byte data) {
   }
 }
 
-// --------------------------------------------------------------------------------------
-// Process
-// --------------------------------------------------------------------------------------
-void tia_Process(uint length) {
-  for(uint index = 0; index < length; index++) {
-    if(tia_counter[0] > 1) {
-      tia_counter[0]--;
-    }
-    else if(tia_counter[0] == 1) {
-      tia_counter[0] = tia_counterMax[0];
-      tia_ProcessChannel(0);
-    }
-    if(tia_counter[1] > 1) {
-      tia_counter[1]--;
-    }
-    else if(tia_counter[1] == 1) {
-      tia_counter[1] = tia_counterMax[1];
-      tia_ProcessChannel(1);
-    }
-    tia_buffer[tia_soundCntr++] = tia_volume[0] + tia_volume[1];
-    if(tia_soundCntr >= tia_size) {
-      tia_soundCntr = 0;
-    }
+// ----------------------------------------------------------------------------
+// Reset
+// ----------------------------------------------------------------------------
+void tia_Reset( ) {
+  tia_soundCntr = 0;
+  for(int index = 0; index < 2; index++) {
+    tia_volume[index] = 0;
+    tia_counterMax[index] = 0;
+    tia_counter[index] = 0;
+    tia_audc[index] = 0;
+    tia_audf[index] = 0;
+    tia_audv[index] = 0;
+    tia_poly4Cntr[index] = 0;
+    tia_poly5Cntr[index] = 0;
+    tia_poly9Cntr[index] = 0;
   }
+  tia_Clear( );
 }
+
+// ----------------------------------------------------------------------------
+// Clear
+// ----------------------------------------------------------------------------
+void tia_Clear( ) {
+  for(int index = 0; index < TIA_BUFFER_SIZE; index++) {
+    tia_buffer[index] = 0;
+  }
+}
+
+// ----------------------------------------------------------------------------
+// SetRegister
+// ----------------------------------------------------------------------------
+// Logs the write against the current sample of the frame; it is applied by
+// tia_WriteRegister when the frame is synthesized.
+void tia_SetRegister(word address, byte data) {
+  switch(address) {
+    case AUDC0:
+    case AUDC1:
+    case AUDF0:
+    case AUDF1:
+    case AUDV0:
+    case AUDV1:
+      break;
+    default:
+      return;
+  }
+
+  sound_Log(address, data);
+}
+
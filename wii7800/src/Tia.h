@@ -51,6 +51,7 @@ typedef unsigned int uint;
 
 extern void tia_Reset( );
 extern void tia_SetRegister(word address, byte data);
+extern void tia_WriteRegister(word address, byte data);
 extern void tia_Clear( );
 extern void tia_Process(uint length);
 extern byte tia_buffer[TIA_BUFFER_SIZE];
@@ -61,3 +61,11 @@ bool timer_IsTime( ) {
     return false;
 }
 
+// ----------------------------------------------------------------------------
+// IsLate
+// Whether the next frame is already due, the emulation is falling behind.
+// ----------------------------------------------------------------------------
+bool timer_IsLate( ) {
+    return (((uInt64)SDL_GetTicks()) * 1000) >= timer_nextTime;
+}
+
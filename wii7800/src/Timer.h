@@ -32,5 +32,6 @@
 extern void timer_Initialize( );
 extern void timer_Reset( );
 extern bool timer_IsTime( );
+extern bool timer_IsLate( );
 
 #endif
@@ -60,8 +60,11 @@ uint wii_sdl_rgb( u8 R, u8 G, u8 B )
  */
 void wii_sdl_black_screen()
 {
-  SDL_FillRect( blit_surface, NULL, SDL_MapRGB(blit_surface->format, 0x0,0x0,0x0 ) );
-  SDL_Flip( blit_surface );
+  if( blit_surface != NULL )
+  {
+    SDL_FillRect( blit_surface, NULL, SDL_MapRGB(blit_surface->format, 0x0,0x0,0x0 ) );
+    SDL_Flip( blit_surface );
+  }
   wii_sdl_black_back_surface();
 }
 
@@ -68,6 +68,7 @@ enum NODETYPE
     NODETYPE_SNAPSHOT,
     NODETYPE_VSYNC,
     NODETYPE_MAX_FRAME_RATE,    
+    NODETYPE_FRAME_SKIP,
     NODETYPE_DIFF_SWITCH_DISPLAY,
     NODETYPE_DIFF_SWITCH_ENABLED,
     NODETYPE_SWAP_BUTTONS,
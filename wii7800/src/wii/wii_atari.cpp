@@ -42,6 +42,7 @@ distribution.
 #include "wii_atari.h"
 #include "wii_atari_input.h"
 #include "wii_atari_sdl.h"
+#include "wii_direct_sound.h"
 
 // The size of the crosshair
 #define CROSSHAIR_SIZE 11
@@ -51,8 +52,6 @@ distribution.
 // they are changed
 #define DIFF_DISPLAY_LENGTH 5
 
-// The palette (8-bit)
-byte atari_pal8[256] = {0};
 // Whether to flash the screen 
 BOOL wii_lightgun_flash = TRUE;
 // Whether to display a crosshair for the lightgun
@@ -85,6 +84,8 @@ int wii_screen_y = DEFAULT_SCREEN_Y;
 short wii_debug = 0;
 // The maximum frame rate
 int wii_max_frame_rate = 0;
+// The frames to skip between displayed frames (or auto)
+int wii_frame_skip = FRAME_SKIP_DISABLED;
 
 // The 7800 scanline that the lightgun is currently at
 int lightgun_scanline = 0;
@@ -113,9 +114,15 @@ static int diff_display_count = 0;
 int wii_ir_x = -100;
 // The y location of the Wiimote (IR)
 int wii_ir_y = -100;
+// The location of the crosshairs on the current frame
+static int crosshair_x = -1;
+static int crosshair_y = -1;
+// Whether the crosshairs were drawn on a narrow frame (at half width)
+static bool crosshair_narrow = false;
 
 // Forward reference
 static void wii_atari_display_crosshairs( int x, int y, BOOL erase );
+static void wii_atari_erase_crosshairs();
 
 // Initializes the menu
 extern void wii_atari_menu_init();
@@ -123,6 +130,9 @@ extern void wii_atari_menu_init();
 extern "C" void WII_VideoStop();
 extern "C" void WII_ChangeSquare(int xscale, int yscale, int xshift, int yshift);
 extern "C" void WII_SetRenderCallback( void (*cb)(void) );
+extern "C" void* WII_PresentTexture( int x, int y, int w, int h );
+extern "C" void WII_FlushTexture( int y, int h );
+extern "C" void WII_CopyTexture( int y, int h );
 
 // 
 // For debug output
@@ -173,6 +183,7 @@ void wii_handle_init()
 void wii_handle_free_resources()
 {   
   wii_write_config();
+  sound_Release();
   wii_sdl_free_resources();
 
   // FreeTypeGX
@@ -193,9 +204,9 @@ void wii_handle_run()
 }
 
 /*
- * Initializes the 8-bit palette
+ * Initializes the palette Maria resolves its colors through
  */
-static void wii_atari_init_palette8()
+static void wii_atari_init_palette()
 {
   const byte *palette;
   if( cartridge_region == REGION_PAL )
@@ -207,13 +218,7 @@ static void wii_atari_init_palette8()
     palette = REGION_PALETTE_NTSC;
   }
 
-  for( uint index = 0; index < 256; index++ ) 
-  {
-    word r = palette[ (index * 3) + 0 ];
-    word g = palette[ (index * 3) + 1 ];
-    word b = palette[ (index * 3) + 2 ]; 
-    atari_pal8[index] = wii_sdl_rgb( r, g, b );
-  }
+  maria_SetPalette( palette );
 }
 
 /*
@@ -282,7 +287,7 @@ bool wii_atari_load_rom( char *filename, bool loadbios )
   }
 
   wii_reset_keyboard_data();
-  wii_atari_init_palette8();   
+  wii_atari_init_palette();   
   prosystem_Reset();
 
   wii_atari_pause( false );
@@ -290,8 +295,42 @@ bool wii_atari_load_rom( char *filename, bool loadbios )
   return true;
 }
 
+/*
+ * Calls the function for each run of rows of tiles from top to bottom that 
+ * holds rows that changed
+ *
+ * top      The first row (a multiple of 4)
+ * bottom   The row past the last one (a multiple of 4)
+ * fn       The function to call with the first row and the number of rows
+ */
+static void wii_atari_for_dirty_rows( 
+  int top, int bottom, void (*fn)( int y, int h ) )
+{
+  int first = -1;
+  for( int row = top; row <= bottom; row += 4 )
+  {
+    bool dirty = ( row < bottom ) && maria_IsDirty( row, 4 );
+    if( dirty && first < 0 )
+    {
+      first = row;
+    }
+    else if( !dirty && first >= 0 )
+    {
+      fn( first, row - first );
+      first = -1;
+    }
+  }
+}
+
 /*
  * Renders the current frame to the Wii
+ *
+ * Maria has already written the frame to the GX texture being drawn, only 
+ * the rows of tiles holding rows that changed are flushed for GX. The 
+ * texture is then shown, with the part the frame occupies selected. When 
+ * the frame only contains 160 pixel lines, that is the left half of the 
+ * columns. The rows that changed are copied to the texture Maria writes 
+ * next, so that it holds the frame just shown.
  */
 void wii_atari_put_image_gu_normal()
 {
@@ -299,30 +338,21 @@ void wii_atari_put_image_gu_normal()
     ( cartridge_region == REGION_PAL ? PAL_ATARI_HEIGHT : NTSC_ATARI_HEIGHT );
   int atari_offsety = 
     ( cartridge_region == REGION_PAL ? PAL_ATARI_BLIT_TOP_Y : NTSC_ATARI_BLIT_TOP_Y ); 
-  int offsetx = ( wii_scale == 1 ? ( ( WII_WIDTH - ATARI_WIDTH ) / 2 ) : 0 );
-  int offsety = ( wii_scale == 1 ? ( ( WII_HEIGHT - atari_height ) / 2 ) : 0 );
-
-  int src = 0, dst = 0, start = 0, x = 0, y = 0, i = 0;
-  byte* backpixels = (byte*)back_surface->pixels;
-  byte* blitpixels = (byte*)blit_surface->pixels;
-  int startoffset = atari_offsety * ATARI_WIDTH;
-  for( y = 0; y < atari_height; y++ )
-  {    
-    start = startoffset + ( y * ATARI_WIDTH );
-    src = 0;
-    dst = ( ( ( y * wii_scale ) + offsety ) * WII_WIDTH ) + offsetx;
-    for( i = 0; i < wii_scale; i++ )
-    {
-      for( x = 0; x < ATARI_WIDTH; x++ )
-      {                
-        for( int j = 0; j < wii_scale; j++ )
-        {
-          backpixels[dst++] = blitpixels[start + src];
-        }
-        src++;
-      }
-    }            
-  }
+
+  bool narrow = maria_IsNarrow();
+
+  // The rows of tiles the frame is displayed from, PAL frames reach past 
+  // row 242
+  int top = atari_offsety & ~3;
+  int bottom = ( atari_offsety + atari_height + 3 ) & ~3;
+  if( bottom > MARIA_SURFACE_ROWS ) bottom = MARIA_SURFACE_ROWS;
+
+  wii_atari_for_dirty_rows( top, bottom, WII_FlushTexture );
+  maria_surface = (byte*)WII_PresentTexture( 
+    0, atari_offsety, ( narrow ? ATARI_WIDTH / 2 : ATARI_WIDTH ), 
+    atari_height );
+  wii_atari_for_dirty_rows( top, bottom, WII_CopyTexture );
+  maria_ClearDirty();
 }
 
 /*
@@ -385,29 +415,38 @@ static void wii_atari_refresh_screen( bool sync, int testframes )
     diff_wait_count--;
   }
 
+  // The rows of the frame are brought to one width before anything is 
+  // drawn over them
+  maria_Fit();
+
   BOOL drawcrosshair = lightgun_enabled && wii_lightgun_crosshair;
   if( drawcrosshair )
   {
-    // Display the crosshairs
+    // Display the crosshairs (they are on the texture until the next frame)
+    crosshair_narrow = maria_IsNarrow();
     wii_atari_display_crosshairs( wii_ir_x, wii_ir_y, FALSE );
+    crosshair_x = wii_ir_x;
+    crosshair_y = wii_ir_y;
   }
 
   wii_atari_put_image_gu_normal();    
-  
-  if( drawcrosshair )
-  {
-    // Erase the crosshairs
-    wii_atari_display_crosshairs( wii_ir_x, wii_ir_y, TRUE );
-  }
 
   if( sync ) 
   {
     wii_sync_video();
   }
+}
 
-  if( testframes < 0 )
-  {    
-    wii_sdl_flip();
+/*
+ * Erases the crosshairs drawn for the previous frame
+ */
+static void wii_atari_erase_crosshairs()
+{
+  if( crosshair_x >= 0 )
+  {
+    wii_atari_display_crosshairs( crosshair_x, crosshair_y, TRUE );
+    crosshair_x = -1;
+    crosshair_y = -1;
   }
 }
 
@@ -422,7 +461,7 @@ static void wii_atari_display_crosshairs( int x, int y, BOOL erase )
 {
   if( x < 0 || y < 0 ) return;
 
-  uint color = 
+  word color = 
     ( erase ? wii_sdl_rgb( 0, 0, 0 ) : wii_sdl_rgb( 0xff, 0xff, 0xff ) );
 
   int cx = ( x - CROSSHAIR_OFFSET ) + cartridge_crosshair_x;
@@ -437,13 +476,59 @@ static void wii_atari_display_crosshairs( int x, int y, BOOL erase )
   cx = x0 + ( cx * xratio );
   cy = y0 + ( cy * yratio );
 
-  wii_sdl_draw_rectangle( 
-    blit_surface, cx, cy + CROSSHAIR_OFFSET, CROSSHAIR_SIZE, 
-    1, color, !erase );
+  if( crosshair_narrow )
+  {
+    // Narrow rows hold a pixel for every two
+    wii_atari_draw_rectangle( 
+      cx >> 1, cy + CROSSHAIR_OFFSET, ( CROSSHAIR_SIZE + 1 ) >> 1, 1, 
+      color, !erase );
+
+    wii_atari_draw_rectangle( 
+      ( cx + CROSSHAIR_OFFSET ) >> 1, cy, 1, CROSSHAIR_SIZE, color, !erase );
+    return;
+  }
+
+  wii_atari_draw_rectangle( 
+    cx, cy + CROSSHAIR_OFFSET, CROSSHAIR_SIZE, 1, color, !erase );
+
+  wii_atari_draw_rectangle( 
+    cx + CROSSHAIR_OFFSET, cy, 1, CROSSHAIR_SIZE, color, !erase );  
+}
+
+/*
+ * Draws the outline of a rectangle on the Atari surface
+ *
+ * x      The x location
+ * y      The y location (surface row)
+ * w      The width
+ * h      The height
+ * color  The color (RGB565)
+ * exor   Whether to exclusive-or the color with the surface
+ */
+void wii_atari_draw_rectangle( 
+  int x, int y, int w, int h, word color, BOOL exor )
+{
+  if( x < 0 ) { w += x; x = 0; }
+  if( y < 0 ) { h += y; y = 0; }
+  if( ( x + w ) > MARIA_SURFACE_WIDTH ) w = MARIA_SURFACE_WIDTH - x;
+  if( ( y + h ) > MARIA_SURFACE_ROWS ) h = MARIA_SURFACE_ROWS - y;
+  if( w <= 0 || h <= 0 ) return;
+
+  // Maria writes these rows again in full
+  maria_Touch( y, h );
 
-  wii_sdl_draw_rectangle( 
-    blit_surface, cx + CROSSHAIR_OFFSET, cy, 1, 
-    CROSSHAIR_SIZE, color, !erase );  
+  for( int yo = 0; yo < h; yo++ )
+  {
+    for( int xo = 0; xo < w; xo++ )
+    {
+      if( yo > 0 && yo < ( h - 1 ) && xo > 0 && xo < ( w - 1 ) ) 
+      {
+        continue;
+      }
+      word* pixel = (word*)maria_GetPixel( x + xo, y + yo );
+      *pixel = ( exor ? ( *pixel ^ color ) : color );
+    }
+  }
 }
 
 /*
@@ -701,6 +786,7 @@ void wii_render_callback()
   {    
     static char text[256] = "";
     static char text2[256] = "";
+    static char text3[256] = "";
     dbg_count++;
 
     if( dbg_count % 60 == 0 )
@@ -722,10 +808,19 @@ void wii_render_callback()
         RANDOM,
         cartridge_hblank
       );       
+
+      uint lines = maria_linesWritten + maria_linesSkipped;
+      sprintf( text3, 
+        "idle: %d, skips: %d, cycles: %d, ver: %d, dl: %d/%d, dirty: %d%%, snd: %d, u/o: %d/%d",
+        sally_idleLoops, sally_idleSkips, sally_idleCycles, sally_verifyErrors,
+        maria_cacheHits, maria_cacheMisses,
+        ( lines > 0 ? (int)( ( maria_linesWritten * 100ULL ) / lines ) : 0 ),
+        GetAudioQueued(), (int)GetAudioUnderruns(), (int)GetAudioOverruns() );
     }
 
     //sprintf( text, "video: %.2f", wii_fps_counter );
     wii_gx_drawtext( -310, 210, 14, text, ftgxWhite, 0 ); 
+    wii_gx_drawtext( -310, 190, 14, text3, ftgxWhite, 0 ); 
 
     if( lightgun_enabled )
     {      
@@ -768,6 +863,8 @@ void wii_atari_main_loop( int testframes )
   float fps_counter;
   u32 timerCount = 0;
   u32 start_time = SDL_GetTicks();
+  int skipped = 0;
+  bool audio_paced = false;
 
   timer_Reset();
 
@@ -785,17 +882,56 @@ void wii_atari_main_loop( int testframes )
 
     if( prosystem_active && !prosystem_paused ) 
     {       
+      // Skipped frames are emulated the same, only their pixels are not 
+      // written or displayed
+      bool skip = false;
+      if( wii_frame_skip == FRAME_SKIP_AUTO )
+      {
+        skip = ( skipped < FRAME_SKIP_MAX ) && 
+          ( audio_paced ? sound_IsLate() : timer_IsLate() );
+      }
+      else if( wii_frame_skip > 0 )
+      {
+        skip = ( skipped < wii_frame_skip );
+      }
+      skipped = ( skip ? skipped + 1 : 0 );
+
+      if( !skip )
+      {
+        wii_atari_erase_crosshairs();
+      }
+      maria_skipFrame = skip;
       prosystem_ExecuteFrame( keyboard_data );
 
-      while( !timer_IsTime() );
+      // Pace by the audio output when it is running, sleeping until its
+      // queue has drained. The frame timer is kept in step so it can take
+      // over if the audio stops.
+      audio_paced = ( testframes < 0 && sound_Wait() );
+      if( audio_paced )
+      {
+        timer_Reset();
+      }
+      else
+      {
+        while( !timer_IsTime() );
+      }
 
       fps_counter = (((float)timerCount++/(SDL_GetTicks()-start_time))*1000.0);
-      wii_atari_refresh_screen( true, testframes );
+      if( !skip )
+      {
+        wii_atari_refresh_screen( true, testframes );
+      }
 
+      // The frame's sound is synthesized on the audio thread while the
+      // next frame is emulated
       if( testframes < 0 )
       {
         sound_Store();
       }
+      else
+      {
+        sound_Flush();
+      }
 
       wii_fps_counter = fps_counter;
 
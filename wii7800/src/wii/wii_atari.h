@@ -60,6 +60,11 @@ distribution.
 #define VSYNC_DISABLED 0
 #define VSYNC_ENABLED 1
 
+// frame skip
+#define FRAME_SKIP_AUTO -1
+#define FRAME_SKIP_DISABLED 0
+#define FRAME_SKIP_MAX 4
+
 // diff switches
 #define DIFF_SWITCH_DISPLAY_DISABLED 0
 #define DIFF_SWITCH_DISPLAY_ALWAYS 1
@@ -103,6 +108,8 @@ extern BOOL wii_diff_switch_display;
 extern short wii_debug;
 // The maximum frame rate
 extern int wii_max_frame_rate;
+// The frames to skip between displayed frames (or auto)
+extern int wii_frame_skip;
 // What is the display size?
 extern u8 wii_scale;
 // The screen X size
@@ -142,4 +149,17 @@ extern void wii_atari_main_loop( int testframes = -1 );
  * pause    Whether to pause or resume
  */
 extern void wii_atari_pause( bool pause );
+
+/*
+ * Draws the outline of a rectangle on the Atari surface
+ *
+ * x      The x location
+ * y      The y location (surface row)
+ * w      The width
+ * h      The height
+ * color  The color (RGB565)
+ * exor   Whether to exclusive-or the color with the surface
+ */
+extern void wii_atari_draw_rectangle( 
+  int x, int y, int w, int h, word color, BOOL exor );
 #endif
@@ -31,6 +31,7 @@ distribution.
 #include "wii_util.h"
 
 #include "wii_atari.h"
+#include "Sally.h"
 
 extern "C" {
 
@@ -50,6 +51,12 @@ void wii_config_handle_read_value( char *name, char* value )
   {
     wii_max_frame_rate = Util_sscandec( value );				
   }
+  else if ( strcmp( name, "FRAME_SKIP" ) == 0 )
+  {
+    wii_frame_skip = Util_sscandec( value );				
+    if( wii_frame_skip < FRAME_SKIP_AUTO ) wii_frame_skip = FRAME_SKIP_AUTO;
+    if( wii_frame_skip > FRAME_SKIP_MAX ) wii_frame_skip = FRAME_SKIP_MAX;
+  }
   else if ( strcmp( name, "TOP_MENU_EXIT" ) == 0 )
   {
     wii_top_menu_exit = Util_sscandec( value );				
@@ -90,6 +97,12 @@ void wii_config_handle_read_value( char *name, char* value )
   {
     wii_cart_cycle_stealing = Util_sscandec( value );
   }
+  else if( strcmp( name, "CPU_ENGINE" ) == 0 )
+  {
+    int engine = Util_sscandec( value );
+    sally_engine = ( engine >= SALLY_ENGINE_INTERPRETER && 
+      engine <= SALLY_ENGINE_VERIFY ) ? engine : SALLY_ENGINE_RUN;
+  }
   else if( strcmp( name, "LIGHTGUN_CROSSHAIR" ) == 0 )
   {
     wii_lightgun_crosshair = Util_sscandec( value );
@@ -117,6 +130,7 @@ void wii_config_handle_write_config( FILE *fp )
 {
   fprintf( fp, "DEBUG=%d\n", wii_debug );
   fprintf( fp, "MAX_FRAME_RATE=%d\n", wii_max_frame_rate );
+  fprintf( fp, "FRAME_SKIP=%d\n", wii_frame_skip );
   fprintf( fp, "TOP_MENU_EXIT=%d\n", wii_top_menu_exit );
   fprintf( fp, "AUTO_LOAD_SNAPSHOT=%d\n", wii_auto_load_snapshot );
   fprintf( fp, "AUTO_SAVE_SNAPSHOT=%d\n", wii_auto_save_snapshot );
@@ -127,6 +141,7 @@ void wii_config_handle_write_config( FILE *fp )
   fprintf( fp, "HIGH_SCORE_CART=%d\n", wii_hs_mode );
   fprintf( fp, "CART_WSYNC=%d\n", wii_cart_wsync );
   fprintf( fp, "CART_CYCLE_STEALING=%d\n", wii_cart_cycle_stealing );
+  fprintf( fp, "CPU_ENGINE=%d\n", sally_engine );
   fprintf( fp, "LIGHTGUN_CROSSHAIR=%d\n", wii_lightgun_crosshair );
   fprintf( fp, "LIGHTGUN_FLASH=%d\n", wii_lightgun_flash );
   fprintf( fp, "SCREEN_X=%d\n", wii_screen_x );
@@ -157,6 +157,7 @@ void wii_start_emulation( char *romfile, const char *savefile, bool reset, bool
       }
 
       wii_sdl_black_screen();
+      maria_Clear();
       WII_VideoStart();      
 
       // Wait until no buttons are pressed
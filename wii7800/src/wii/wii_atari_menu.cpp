@@ -163,6 +163,11 @@ void wii_atari_menu_init()
   child->x = -2; child->value_x = -3;
   wii_add_child( display, child );
 
+  child = wii_create_tree_node( NODETYPE_FRAME_SKIP, 
+    "Frame skip " );        
+  child->x = -2; child->value_x = -3;
+  wii_add_child( display, child );
+
   child = wii_create_tree_node( NODETYPE_VSYNC, 
     "Vertical sync " );      
   child->x = -2; child->value_x = -3;
@@ -401,6 +406,20 @@ void wii_menu_handle_get_node_name(
       snprintf( value, WII_MENU_BUFF_SIZE, "%d", wii_max_frame_rate );
     }
     break;
+  case NODETYPE_FRAME_SKIP:
+    if( wii_frame_skip == FRAME_SKIP_AUTO )
+    {
+      snprintf( value, WII_MENU_BUFF_SIZE, "Auto" );
+    }
+    else if( wii_frame_skip == FRAME_SKIP_DISABLED )
+    {
+      snprintf( value, WII_MENU_BUFF_SIZE, "Disabled (Default)" );
+    }
+    else
+    {
+      snprintf( value, WII_MENU_BUFF_SIZE, "%d", wii_frame_skip );
+    }
+    break;
   case NODETYPE_DEBUG_MODE:
   case NODETYPE_TOP_MENU_EXIT:
   case NODETYPE_AUTO_LOAD_SNAPSHOT:
@@ -467,9 +486,13 @@ void wii_menu_handle_select_node( TREENODE *node )
         NTSC_ATARI_BLIT_TOP_Y : PAL_ATARI_BLIT_TOP_Y );
       int height = ( cartridge_region == REGION_NTSC ? 
         NTSC_ATARI_HEIGHT : PAL_ATARI_HEIGHT );
-      wii_resize_screen_draw_border( blit_surface, blity, height );
+      maria_Widen();
+      wii_atari_draw_rectangle( 
+        0, blity, ATARI_WIDTH, height, wii_sdl_rgb( 0xff, 0xff, 0xff ), FALSE );
+      wii_atari_draw_rectangle( 
+        1, blity + 1, ATARI_WIDTH - 2, height - 2, 
+        wii_sdl_rgb( 0, 0, 0 ), FALSE );
       wii_atari_put_image_gu_normal();
-      wii_sdl_flip(); 
       resize_info rinfo = { 
         DEFAULT_SCREEN_X, DEFAULT_SCREEN_Y, wii_screen_x, wii_screen_y };
       wii_resize_screen_gui( &rinfo );
@@ -541,6 +564,13 @@ void wii_menu_handle_select_node( TREENODE *node )
       wii_max_frame_rate = 30;
     }
     break;
+  case NODETYPE_FRAME_SKIP:
+    wii_frame_skip += 1;
+    if( wii_frame_skip > FRAME_SKIP_MAX )
+    {
+      wii_frame_skip = FRAME_SKIP_AUTO;
+    }
+    break;
   case NODETYPE_TOP_MENU_EXIT:
     wii_top_menu_exit ^= 1;
     break;
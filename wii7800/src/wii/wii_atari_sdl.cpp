@@ -24,6 +24,8 @@ must not be misrepresented as being the original software.
 distribution.
 */
 
+#include "Maria.h"
+
 #include <gccore.h>
 
 #include "wii_main.h"
@@ -31,14 +33,19 @@ distribution.
 
 #include "wii_atari.h"
 
+extern "C" void* WII_SetDirectTexture( int width, int height, f32 xscale, f32 yscale );
+
+// The GX texture Maria renders to
+static void* atari_texture = NULL;
+
 /*
- * Returns the Atari blit surface
+ * Returns the Atari blit surface (the GX texture)
  *
  * return   The Atari blit surface
  */
 u8* wii_sdl_get_blit_addr()
 {
-  return (u8*)blit_surface->pixels;  
+  return (u8*)atari_texture;  
 }
 
 /*
@@ -58,7 +65,7 @@ int wii_sdl_handle_init()
     SDL_SetVideoMode(
     WII_WIDTH,
     WII_HEIGHT, 
-    8, 
+    16, 
     SDL_DOUBLEBUF|SDL_HWSURFACE
     );
 
@@ -67,15 +74,21 @@ int wii_sdl_handle_init()
     return 0;
   }
 
-  blit_surface = 
-    SDL_CreateRGBSurface(
-    SDL_SWSURFACE, 
-    ATARI_WIDTH, 
+  // Maria writes the frame in the tiled layout of the texture, GX scales it
+  // to the part of the screen it used to occupy.
+  atari_texture = 
+    WII_SetDirectTexture(
+    ATARI_WIDTH,
     ATARI_BLIT_HEIGHT,
-    back_surface->format->BitsPerPixel,
-    back_surface->format->Rmask,
-    back_surface->format->Gmask,
-    back_surface->format->Bmask, 0);
+    (f32)( ATARI_WIDTH * wii_scale ) / WII_WIDTH,
+    (f32)( NTSC_ATARI_HEIGHT * wii_scale ) / WII_HEIGHT );
+
+  if( !atari_texture )
+  {
+    return 0;
+  }
+
+  maria_layout = MARIA_LAYOUT_TILED;
 
   return 1;
 }
\ No newline at end of file
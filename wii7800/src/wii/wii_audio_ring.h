@@ -0,0 +1,150 @@
+/****************************************************************************
+* wii_audio_ring.h
+*
+* Single producer/single consumer ring of stereo sample frames.
+*
+* The emulation thread is the only writer of the head index and the audio
+* consumer (the DMA callback on the Wii, the SDL audio callback on a host)
+* is the only writer of the tail index, so no locks are needed. Each side
+* publishes its index only after a barrier, which orders the sample copies
+* before the index store (release) and the index load before the sample
+* copies (acquire).
+****************************************************************************/
+
+#ifndef WII_AUDIO_RING_H
+#define WII_AUDIO_RING_H
+
+#include <stdint.h>
+#include <string.h>
+
+#define AUDIO_RING_ACQUIRE() __sync_synchronize()
+#define AUDIO_RING_RELEASE() __sync_synchronize()
+
+typedef struct audio_ring
+{
+  /* Frame storage, size must be a power of two */
+  uint32_t *buffer;
+  uint32_t size;
+  /* Free running indexes, only masked when addressing the buffer */
+  volatile uint32_t head;
+  volatile uint32_t tail;
+  /* Writes that did not fit (producer) and reads that found it empty
+     (consumer) */
+  volatile uint32_t overruns;
+  volatile uint32_t underruns;
+} audio_ring;
+
+/*
+ * Attaches the storage to the ring and empties it. Only safe while neither
+ * side is running.
+ */
+static inline void audio_ring_init( audio_ring *ring, uint32_t *buffer,
+  uint32_t size )
+{
+  ring->buffer = buffer;
+  ring->size = size;
+  ring->head = ring->tail = 0;
+  ring->overruns = ring->underruns = 0;
+}
+
+/*
+ * Returns the number of frames queued in the ring
+ */
+static inline uint32_t audio_ring_fill( const audio_ring *ring )
+{
+  return ring->head - ring->tail;
+}
+
+/*
+ * Producer: returns how many of count frames fit in the ring, counting an
+ * overrun when not all of them do. The frames are then stored in place with
+ * audio_ring_put and published with audio_ring_commit.
+ */
+static inline uint32_t audio_ring_reserve( audio_ring *ring, uint32_t count )
+{
+  uint32_t tail = ring->tail;
+  AUDIO_RING_ACQUIRE();
+
+  uint32_t space = ring->size - ( ring->head - tail );
+  if( count > space )
+  {
+    ring->overruns++;
+    count = space;
+  }
+  return count;
+}
+
+/*
+ * Producer: stores a frame at the given offset past the head
+ */
+static inline void audio_ring_put( audio_ring *ring, uint32_t index, 
+  uint32_t frame )
+{
+  ring->buffer[( ring->head + index ) & ( ring->size - 1 )] = frame;
+}
+
+/*
+ * Producer: publishes count stored frames to the consumer
+ */
+static inline void audio_ring_commit( audio_ring *ring, uint32_t count )
+{
+  AUDIO_RING_RELEASE();
+  ring->head = ring->head + count;
+}
+
+/*
+ * Producer: copies up to count frames into the ring. Frames that do not
+ * fit are dropped (and counted) rather than overwriting unread ones.
+ *
+ * Returns the number of frames written
+ */
+static inline uint32_t audio_ring_write( audio_ring *ring,
+  const uint32_t *src, uint32_t count )
+{
+  count = audio_ring_reserve( ring, count );
+
+  uint32_t mask = ring->size - 1;
+  uint32_t start = ring->head & mask;
+  uint32_t first = ring->size - start;
+  if( first > count ) first = count;
+  memcpy( ring->buffer + start, src, first << 2 );
+  memcpy( ring->buffer, src + first, ( count - first ) << 2 );
+
+  audio_ring_commit( ring, count );
+  return count;
+}
+
+/*
+ * Consumer: copies up to count frames out of the ring. An empty read is
+ * counted as an underrun.
+ *
+ * Returns the number of frames read
+ */
+static inline uint32_t audio_ring_read( audio_ring *ring, uint32_t *dst,
+  uint32_t count )
+{
+  uint32_t tail = ring->tail;
+  uint32_t head = ring->head;
+  AUDIO_RING_ACQUIRE();
+
+  uint32_t avail = head - tail;
+  if( count > avail ) count = avail;
+  if( count == 0 )
+  {
+    ring->underruns++;
+    return 0;
+  }
+
+  uint32_t mask = ring->size - 1;
+  uint32_t start = tail & mask;
+  uint32_t first = ring->size - start;
+  if( first > count ) first = count;
+  memcpy( dst, ring->buffer + start, first << 2 );
+  memcpy( dst + first, ring->buffer, ( count - first ) << 2 );
+
+  AUDIO_RING_RELEASE();
+  ring->tail = tail + count;
+  return count;
+}
+
+#endif
@@ -10,53 +10,60 @@
 * Audio driver
 ****************************************************************************/
 
+#ifdef WII
+
 #include <gccore.h>
 #include <string.h>
 
-#define SAMPLERATE 48000  
+#include "wii_audio_ring.h"
+#include "wii_direct_sound.h"
 
-#define MIXBUFSIZE_BYTES 32000 //16000
-#define MIXBUFSIZE_SHORT (MIXBUFSIZE_BYTES / 2)
-#define MIXBUFSIZE_WORDS (MIXBUFSIZE_BYTES / 4)
+#define SAMPLERATE 48000  
 
 #define SOUNDBUFSIZE  4096 //2048
 
+// DMA lengths must be a multiple of 32 bytes (8 frames)
+#define DMA_ALIGN_FRAMES 8
+// Frames played while the ring is empty, keeps the DMA callback running
+#define SILENCE_FRAMES 256
+
 static u8 soundbuffer[2][SOUNDBUFSIZE] ATTRIBUTE_ALIGN(32);
-static u8 mixbuffer[MIXBUFSIZE_BYTES];
-static int mixhead = 0;
-static int mixtail = 0;
+static u32 mixbuffer[AUDIO_RING_FRAMES];
+static audio_ring mixring;
+// The last frame played, held while the ring is empty. The samples are
+// not centered on zero, so padding with zeros would pop.
+static u32 lastframe = 0;
 static int whichab = 0;
-static int IsPlaying = 0;
+static volatile int IsPlaying = 0;
+static lwpq_t audioqueue = LWP_TQUEUE_NULL;
 
 /****************************************************************************
 * MixerCollect
 *
-* Collects sound samples from mixbuffer and puts them into outbuffer
-* Makes sure to align them to 32 bytes for AUDIO_InitDMA
+* Collects sound samples from the ring and puts them into outbuffer. The
+* length is padded with the last frame to whole 32 byte blocks for
+* AUDIO_InitDMA, and a short block of it is played when the ring is empty.
 ***************************************************************************/
 static int MixerCollect( u8 *outbuffer, int len )
 {
-  u32 *dst = (u32 *)outbuffer;
-  u32 *src = (u32 *)mixbuffer;
-  int done = 0;
-
-  // Always clear output buffer
-  memset(outbuffer, 0, len);
-
-  while ( ( mixtail != mixhead ) && ( done < len ) )
+  u32 *frames = (u32*)outbuffer;
+  int done = audio_ring_read( &mixring, frames, len >> 2 );
+  if( done > 0 )
   {
-    *dst++ = src[mixtail++];
-    if (mixtail == MIXBUFSIZE_WORDS) mixtail = 0;
-    done += 4;
+    lastframe = frames[done - 1];
   }
 
-  // Realign to 32 bytes for DMA
-  mixtail -= ((done&0x1f) >> 2);
-  if (mixtail < 0)
-    mixtail += MIXBUFSIZE_WORDS;
-  done &= ~0x1f;
+  int padded = ( done + DMA_ALIGN_FRAMES - 1 ) & ~( DMA_ALIGN_FRAMES - 1 );
+  if( padded == 0 )
+  {
+    padded = SILENCE_FRAMES;
+  }
+  for( int index = done; index < padded; index++ )
+  {
+    frames[index] = lastframe;
+  }
 
-  return done;
+  return padded << 2;
 }
 
 /****************************************************************************
@@ -67,14 +74,15 @@ static int MixerCollect( u8 *outbuffer, int len )
 static void AudioSwitchBuffers()
 {
   int len = MixerCollect( soundbuffer[whichab], SOUNDBUFSIZE );
-  if (len == 0) 
-    return;
 
   DCFlushRange(soundbuffer[whichab], len);
   AUDIO_InitDMA((u32)soundbuffer[whichab], len);
   AUDIO_StartDMA();
   whichab ^= 1;  
   IsPlaying = 1;   
+
+  // Wake the emulation if it is waiting for the ring to drain
+  LWP_ThreadSignal( audioqueue );
 }
 
 /****************************************************************************
@@ -86,9 +94,11 @@ void InitialiseAudio()
 {
   AUDIO_Init(NULL); // Start audio subsystem
   AUDIO_SetDSPSampleRate(AI_SAMPLERATE_48KHZ);
+  LWP_InitQueue( &audioqueue );
   AUDIO_RegisterDMACallback( AudioSwitchBuffers );    
   memset(soundbuffer, 0, SOUNDBUFSIZE*2);
-  memset(mixbuffer, 0, MIXBUFSIZE_BYTES);
+  memset(mixbuffer, 0, sizeof(mixbuffer));
+  audio_ring_init( &mixring, mixbuffer, AUDIO_RING_FRAMES );
 }
 
 /****************************************************************************
@@ -105,32 +115,61 @@ void StopAudio()
 /****************************************************************************
 * ResetAudio
 *
-* Reset audio output when loading a new game
+* Reset audio output when loading a new game. The DMA is stopped first so
+* the callback is not reading the ring while it is emptied.
 ***************************************************************************/
 void ResetAudio()
 {
+  StopAudio();
   memset(soundbuffer, 0, SOUNDBUFSIZE*2);
-  memset(mixbuffer, 0, MIXBUFSIZE_BYTES);
-  mixhead = mixtail = 0;
+  memset(mixbuffer, 0, sizeof(mixbuffer));
+  audio_ring_init( &mixring, mixbuffer, AUDIO_RING_FRAMES );
 }
 
 /****************************************************************************
 * PlaySound
 *
-* Puts incoming mono samples into mixbuffer
-* Splits mono samples into two channels (stereo)
+* Queues incoming stereo frames in the ring
 ****************************************************************************/
 void PlaySound( u32 *Buffer, int count )
 {
-  u32 *dst = (u32 *)mixbuffer;
-  int i;
+  audio_ring_write( &mixring, Buffer, count );
 
-  for( i = 0; i < count; i++ )
+  // Restart Sound Processing if stopped
+  if (IsPlaying == 0)
   {
-    dst[mixhead++] = Buffer[i];
-    if (mixhead == MIXBUFSIZE_WORDS)
-      mixhead = 0;
+    AudioSwitchBuffers ();
   }
+}
+
+/****************************************************************************
+* GetAudioFormat
+*
+* The DSP takes big endian samples, the same byte order as the CPU
+****************************************************************************/
+int GetAudioFormat()
+{
+  return AUDIO_FORMAT_S16_NATIVE;
+}
+
+/****************************************************************************
+* GetSoundRing
+*
+* Returns the ring for writing frames in place
+****************************************************************************/
+audio_ring *GetSoundRing()
+{
+  return &mixring;
+}
+
+/****************************************************************************
+* CommitSound
+*
+* Publishes frames written in place and restarts output if stopped
+****************************************************************************/
+void CommitSound( int count )
+{
+  audio_ring_commit( &mixring, count );
 
   // Restart Sound Processing if stopped
   if (IsPlaying == 0)
@@ -138,3 +177,56 @@ void PlaySound( u32 *Buffer, int count )
     AudioSwitchBuffers ();
   }
 }
+
+/****************************************************************************
+* WaitAudio
+*
+* Sleeps until no more than frames are queued, woken by each DMA callback.
+* The fill check and the sleep are done with interrupts disabled, so the
+* callback cannot signal the queue in between and leave the wait hanging.
+* Returns 0 without waiting if the DMA is not running.
+****************************************************************************/
+int WaitAudio( int frames )
+{
+  u32 level;
+  _CPU_ISR_Disable( level );
+  while( audio_ring_fill( &mixring ) > (u32)frames && IsPlaying )
+  {
+    LWP_ThreadSleep( audioqueue );
+  }
+  int playing = IsPlaying;
+  _CPU_ISR_Restore( level );
+  return playing;
+}
+
+/****************************************************************************
+* GetAudioQueued
+*
+* Returns the number of frames queued and not yet played
+****************************************************************************/
+int GetAudioQueued()
+{
+  return audio_ring_fill( &mixring );
+}
+
+/****************************************************************************
+* GetAudioOverruns
+*
+* Returns the number of writes that did not fit in the ring
+****************************************************************************/
+uint32_t GetAudioOverruns()
+{
+  return mixring.overruns;
+}
+
+/****************************************************************************
+* GetAudioUnderruns
+*
+* Returns the number of times the DMA found the ring empty
+****************************************************************************/
+uint32_t GetAudioUnderruns()
+{
+  return mixring.underruns;
+}
+
+#endif
@@ -12,10 +12,36 @@
 ****************************************************************************/
 
 #include <stdint.h>
-#include <gccore.h>
+
+#include "wii_audio_ring.h"
+
+/* Size of the output ring in stereo frames */
+#define AUDIO_RING_FRAMES 8192
+
+/* Sample formats of the output, 16 bit stereo in native or swapped byte
+   order */
+#define AUDIO_FORMAT_S16_NATIVE 0
+#define AUDIO_FORMAT_S16_SWAPPED 1
 
 void InitialiseAudio();
 void StopAudio();
 void ResetAudio();
-void PlaySound( u32 *Buffer, int samples );
+void PlaySound( uint32_t *Buffer, int samples );
+
+/* Format the output expects, fixed once the audio is initialised */
+int GetAudioFormat();
+/* Ring to write frames into in place, see audio_ring_reserve */
+audio_ring *GetSoundRing();
+/* Publishes count frames written to the ring and starts output if stopped */
+void CommitSound( int count );
+
+/* Blocks until no more than frames are queued, returns 0 without waiting
+   when output is not running */
+int WaitAudio( int frames );
+/* Number of frames queued and not yet played */
+int GetAudioQueued();
+/* Number of writes that did not fit in the ring */
+uint32_t GetAudioOverruns();
+/* Number of times the output found the ring empty */
+uint32_t GetAudioUnderruns();
 
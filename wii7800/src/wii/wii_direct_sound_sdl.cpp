@@ -0,0 +1,207 @@
+/****************************************************************************
+* wii_direct_sound_sdl.cpp
+*
+* Host (SDL) implementation of the direct sound interface. The SDL audio
+* callback takes the place of the Wii DMA callback as the ring's consumer,
+* which allows the ring to be exercised off the console.
+****************************************************************************/
+
+#ifndef WII
+
+#include <SDL.h>
+#include <string.h>
+
+#include "wii_audio_ring.h"
+#include "wii_direct_sound.h"
+
+#define SAMPLERATE 48000
+#define SOUNDBUFSIZE 1024
+
+static uint32_t mixbuffer[AUDIO_RING_FRAMES];
+static audio_ring mixring;
+// The last frame played, held while the ring is empty. The samples are
+// not centered on zero, so padding with zeros would pop.
+static uint32_t lastframe = 0;
+static int IsOpen = 0;
+static int Format = AUDIO_FORMAT_S16_NATIVE;
+static int IsPlaying = 0;
+
+/****************************************************************************
+* MixerCollect
+*
+* SDL audio callback, copies queued frames to the device and pads with
+* the last frame when the ring runs dry
+***************************************************************************/
+static void MixerCollect( void *userdata, Uint8 *stream, int len )
+{
+  uint32_t *frames = (uint32_t*)stream;
+  int count = len >> 2;
+  int done = audio_ring_read( &mixring, frames, count );
+  if( done > 0 )
+  {
+    lastframe = frames[done - 1];
+  }
+  for( int index = done; index < count; index++ )
+  {
+    frames[index] = lastframe;
+  }
+}
+
+/****************************************************************************
+* InitialiseAudio
+*
+* Opens the audio device for 16 bit stereo frames. Either byte order is
+* accepted as is, anything else is left to SDL to convert.
+***************************************************************************/
+void InitialiseAudio()
+{
+  memset( mixbuffer, 0, sizeof( mixbuffer ) );
+  audio_ring_init( &mixring, mixbuffer, AUDIO_RING_FRAMES );
+
+  SDL_AudioSpec desired;
+  memset( &desired, 0, sizeof( desired ) );
+  desired.freq = SAMPLERATE;
+  desired.format = AUDIO_S16SYS;
+  desired.channels = 2;
+  desired.samples = SOUNDBUFSIZE;
+  desired.callback = MixerCollect;
+
+  SDL_AudioSpec obtained;
+  IsOpen = ( SDL_OpenAudio( &desired, &obtained ) == 0 );
+  if( IsOpen && 
+      ( obtained.freq != SAMPLERATE || obtained.channels != 2 ||
+        ( obtained.format != AUDIO_S16LSB && 
+          obtained.format != AUDIO_S16MSB ) ) )
+  {
+    SDL_CloseAudio();
+    IsOpen = ( SDL_OpenAudio( &desired, NULL ) == 0 );
+    obtained.format = desired.format;
+  }
+
+  Format = ( IsOpen && obtained.format != AUDIO_S16SYS ) ?
+    AUDIO_FORMAT_S16_SWAPPED : AUDIO_FORMAT_S16_NATIVE;
+}
+
+/****************************************************************************
+* StopAudio
+*
+* Pause audio output when returning to menu
+***************************************************************************/
+void StopAudio()
+{
+  if( IsOpen ) SDL_PauseAudio( 1 );
+  IsPlaying = 0;
+}
+
+/****************************************************************************
+* ResetAudio
+*
+* Reset audio output when loading a new game
+***************************************************************************/
+void ResetAudio()
+{
+  StopAudio();
+  SDL_LockAudio();
+  audio_ring_init( &mixring, mixbuffer, AUDIO_RING_FRAMES );
+  SDL_UnlockAudio();
+}
+
+/****************************************************************************
+* PlaySound
+*
+* Queues incoming stereo frames in the ring
+****************************************************************************/
+void PlaySound( uint32_t *Buffer, int count )
+{
+  audio_ring_write( &mixring, Buffer, count );
+
+  if( IsOpen && !IsPlaying )
+  {
+    SDL_PauseAudio( 0 );
+    IsPlaying = 1;
+  }
+}
+
+/****************************************************************************
+* GetAudioFormat
+*
+* Returns the byte order the device was opened with
+****************************************************************************/
+int GetAudioFormat()
+{
+  return Format;
+}
+
+/****************************************************************************
+* GetSoundRing
+*
+* Returns the ring for writing frames in place
+****************************************************************************/
+audio_ring *GetSoundRing()
+{
+  return &mixring;
+}
+
+/****************************************************************************
+* CommitSound
+*
+* Publishes frames written in place and starts the device if paused
+****************************************************************************/
+void CommitSound( int count )
+{
+  audio_ring_commit( &mixring, count );
+
+  if( IsOpen && !IsPlaying )
+  {
+    SDL_PauseAudio( 0 );
+    IsPlaying = 1;
+  }
+}
+
+/****************************************************************************
+* WaitAudio
+*
+* Sleeps until no more than frames are queued. Returns 0 without waiting if
+* the device is not playing.
+****************************************************************************/
+int WaitAudio( int frames )
+{
+  while( audio_ring_fill( &mixring ) > (uint32_t)frames )
+  {
+    if( !IsPlaying ) return 0;
+    SDL_Delay( 1 );
+  }
+  return IsPlaying;
+}
+
+/****************************************************************************
+* GetAudioQueued
+*
+* Returns the number of frames queued and not yet played
+****************************************************************************/
+int GetAudioQueued()
+{
+  return audio_ring_fill( &mixring );
+}
+
+/****************************************************************************
+* GetAudioOverruns
+*
+* Returns the number of writes that did not fit in the ring
+****************************************************************************/
+uint32_t GetAudioOverruns()
+{
+  return mixring.overruns;
+}
+
+/****************************************************************************
+* GetAudioUnderruns
+*
+* Returns the number of times the device found the ring empty
+****************************************************************************/
+uint32_t GetAudioUnderruns()
+{
+  return mixring.underruns;
+}
+
+#endif
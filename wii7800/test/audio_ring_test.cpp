@@ -0,0 +1,135 @@
+/****************************************************************************
+* audio_ring_test.cpp
+*
+* The SPSC audio ring: wrap around, overrun and underrun counting on a
+* single thread, then a producer thread against a consumer thread, checking
+* that every frame arrives once and in order and that the counters match
+* what each side saw.
+****************************************************************************/
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "wii_audio_ring.h"
+#include "test.h"
+
+#define STRESS_RING_FRAMES 256
+#define STRESS_FRAMES 4000000
+#define STRESS_CHUNK 300
+
+static void TestSingleThread()
+{
+  uint32_t buffer[16];
+  uint32_t out[32];
+  uint32_t in[32];
+  for( uint32_t index = 0; index < 32; index++ ) in[index] = index + 1;
+
+  audio_ring ring;
+  audio_ring_init( &ring, buffer, 16 );
+
+  // Empty reads are underruns
+  CHECK( audio_ring_read( &ring, out, 8 ) == 0 );
+  CHECK( ring.underruns == 1 );
+
+  // Only the frames that fit are written, once counted as an overrun
+  CHECK( audio_ring_write( &ring, in, 20 ) == 16 );
+  CHECK( ring.overruns == 1 );
+  CHECK( audio_ring_fill( &ring ) == 16 );
+  CHECK( audio_ring_write( &ring, in, 1 ) == 0 );
+  CHECK( ring.overruns == 2 );
+
+  // A partial read, then a write that wraps around the end of the buffer
+  CHECK( audio_ring_read( &ring, out, 5 ) == 5 );
+  for( uint32_t index = 0; index < 5; index++ ) CHECK( out[index] == index + 1 );
+  CHECK( audio_ring_write( &ring, in + 16, 5 ) == 5 );
+  CHECK( ring.overruns == 2 );
+
+  // A read of more than is queued returns what is there, across the wrap
+  CHECK( audio_ring_read( &ring, out, 32 ) == 16 );
+  for( uint32_t index = 0; index < 16; index++ ) CHECK( out[index] == index + 6 );
+  CHECK( audio_ring_fill( &ring ) == 0 );
+  CHECK( ring.underruns == 1 );
+
+  // Frames stored in place are only visible once committed
+  uint32_t count = audio_ring_reserve( &ring, 3 );
+  CHECK( count == 3 );
+  for( uint32_t index = 0; index < count; index++ )
+  {
+    audio_ring_put( &ring, index, 100 + index );
+  }
+  CHECK( audio_ring_fill( &ring ) == 0 );
+  audio_ring_commit( &ring, count );
+  CHECK( audio_ring_read( &ring, out, 8 ) == 3 );
+  CHECK( out[0] == 100 && out[1] == 101 && out[2] == 102 );
+  CHECK( audio_ring_read( &ring, out, 8 ) == 0 );
+  CHECK( ring.underruns == 2 );
+}
+
+static uint32_t stressBuffer[STRESS_RING_FRAMES];
+static audio_ring stressRing;
+static uint32_t producerOverruns = 0;
+
+static void *Producer( void * )
+{
+  unsigned int seed = 2;
+  uint32_t chunk[STRESS_CHUNK];
+  uint32_t next = 1;
+  while( next <= STRESS_FRAMES )
+  {
+    uint32_t count = 1 + rand_r( &seed ) % STRESS_CHUNK;
+    if( count > STRESS_FRAMES + 1 - next ) count = STRESS_FRAMES + 1 - next;
+    for( uint32_t index = 0; index < count; index++ )
+    {
+      chunk[index] = next + index;
+    }
+    // Frames that did not fit are offered again
+    uint32_t written = audio_ring_write( &stressRing, chunk, count );
+    if( written < count ) producerOverruns++;
+    next += written;
+    if( rand_r( &seed ) % 64 == 0 ) usleep( 50 );
+  }
+  return NULL;
+}
+
+static void TestProducerConsumer()
+{
+  audio_ring_init( &stressRing, stressBuffer, STRESS_RING_FRAMES );
+
+  pthread_t producer;
+  CHECK( pthread_create( &producer, NULL, Producer, NULL ) == 0 );
+
+  unsigned int seed = 3;
+  uint32_t out[STRESS_CHUNK];
+  uint32_t expected = 1;
+  uint32_t emptyReads = 0;
+  uint32_t misses = 0;
+  while( expected <= STRESS_FRAMES )
+  {
+    uint32_t count = audio_ring_read( 
+      &stressRing, out, 1 + rand_r( &seed ) % STRESS_CHUNK );
+    if( count == 0 ) emptyReads++;
+    for( uint32_t index = 0; index < count; index++ )
+    {
+      if( out[index] != expected + index ) misses++;
+    }
+    expected += count;
+    if( rand_r( &seed ) % 64 == 0 ) usleep( 50 );
+  }
+  pthread_join( producer, NULL );
+
+  CHECK( misses == 0 );
+  CHECK( expected == STRESS_FRAMES + 1 );
+  CHECK( audio_ring_fill( &stressRing ) == 0 );
+  CHECK( stressRing.overruns == producerOverruns );
+  CHECK( stressRing.underruns == emptyReads );
+  printf( "%u frames, %u overruns, %u underruns\n", STRESS_FRAMES, 
+    stressRing.overruns, stressRing.underruns );
+}
+
+int main()
+{
+  TestSingleThread();
+  TestProducerConsumer();
+  return TEST_RESULT( "audio_ring_test" );
+}
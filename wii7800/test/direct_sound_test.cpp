@@ -0,0 +1,86 @@
+/****************************************************************************
+* direct_sound_test.cpp
+*
+* The host direct sound driver (wii_direct_sound_sdl.cpp) against a fake
+* sound device thread. The emulation side queues numbered frames, pausing
+* now and then so the device runs dry, and every frame has to be played
+* once and in order, with an underrun counted for each buffer the device
+* had to fill with padding alone. Padding has to hold the last frame
+* played, so the output never steps back to zero.
+****************************************************************************/
+
+#include <stdlib.h>
+#include <unistd.h>
+#include <vector>
+
+#include "SDL.h"
+#include "wii_direct_sound.h"
+#include "test.h"
+
+#define TEST_FRAMES 400000
+#define TEST_CHUNK 800
+
+// Filled by the device thread, only read once the device is paused. The
+// frames are numbered from 1, so a frame that repeats the one before it is
+// padding, anything else is taken as played (and out of order if wrong).
+static std::vector<uint32_t> played;
+static uint32_t previous = 0;
+static uint32_t paddedBuffers = 0;
+
+static void Sink( const Uint8 *stream, int len )
+{
+  const uint32_t *frames = (const uint32_t*)stream;
+  int count = len >> 2;
+  if( frames[0] == previous ) paddedBuffers++;
+  for( int index = 0; index < count; index++ )
+  {
+    if( frames[index] != previous )
+    {
+      played.push_back( frames[index] );
+      previous = frames[index];
+    }
+  }
+}
+
+int main()
+{
+  fake_audio_sink = Sink;
+  InitialiseAudio();
+  CHECK( GetAudioFormat() == AUDIO_FORMAT_S16_NATIVE );
+
+  unsigned int seed = 4;
+  uint32_t chunk[TEST_CHUNK];
+  uint32_t next = 1;
+  while( next <= TEST_FRAMES )
+  {
+    uint32_t count = 1 + rand_r( &seed ) % TEST_CHUNK;
+    if( count > TEST_FRAMES + 1 - next ) count = TEST_FRAMES + 1 - next;
+    for( uint32_t index = 0; index < count; index++ )
+    {
+      chunk[index] = next + index;
+    }
+    WaitAudio( AUDIO_RING_FRAMES - count );
+    PlaySound( chunk, count );
+    next += count;
+    if( rand_r( &seed ) % 32 == 0 ) usleep( 5000 );
+  }
+  WaitAudio( 0 );
+  StopAudio();
+
+  uint32_t misses = 0;
+  for( uint32_t index = 0; index < played.size(); index++ )
+  {
+    if( played[index] != index + 1 ) misses++;
+  }
+  CHECK( played.size() == TEST_FRAMES );
+  CHECK( misses == 0 );
+  CHECK( GetAudioQueued() == 0 );
+  CHECK( GetAudioOverruns() == 0 );
+  CHECK( paddedBuffers > 0 );
+  CHECK( GetAudioUnderruns() == paddedBuffers );
+  printf( "%u frames, %u underruns\n", (unsigned)played.size(), 
+    GetAudioUnderruns() );
+
+  SDL_CloseAudio();
+  return TEST_RESULT( "direct_sound_test" );
+}
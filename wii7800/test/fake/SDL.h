@@ -0,0 +1,50 @@
+/****************************************************************************
+* SDL.h
+*
+* The part of the SDL 1.2 audio interface used by wii_direct_sound_sdl.cpp,
+* backed by a thread that calls the audio callback the way a sound device
+* would. The test reads what the device played through fake_audio_sink.
+****************************************************************************/
+
+#ifndef FAKE_SDL_H
+#define FAKE_SDL_H
+
+#include <stdint.h>
+
+typedef uint8_t Uint8;
+typedef uint16_t Uint16;
+typedef uint32_t Uint32;
+
+#define AUDIO_S16LSB 0x8010
+#define AUDIO_S16MSB 0x9010
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+#define AUDIO_S16SYS AUDIO_S16MSB
+#else
+#define AUDIO_S16SYS AUDIO_S16LSB
+#endif
+
+typedef struct SDL_AudioSpec
+{
+  int freq;
+  Uint16 format;
+  Uint8 channels;
+  Uint8 silence;
+  Uint16 samples;
+  Uint16 padding;
+  Uint32 size;
+  void (*callback)( void *userdata, Uint8 *stream, int len );
+  void *userdata;
+} SDL_AudioSpec;
+
+int SDL_OpenAudio( SDL_AudioSpec *desired, SDL_AudioSpec *obtained );
+void SDL_CloseAudio();
+void SDL_PauseAudio( int pause_on );
+void SDL_LockAudio();
+void SDL_UnlockAudio();
+void SDL_Delay( Uint32 ms );
+
+/* Called by the device thread with each buffer the callback filled, while
+   the audio is locked */
+extern void (*fake_audio_sink)( const Uint8 *stream, int len );
+
+#endif
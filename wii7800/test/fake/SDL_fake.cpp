@@ -0,0 +1,81 @@
+/****************************************************************************
+* SDL_fake.cpp
+*
+* Sound device thread for the fake SDL audio interface. The callback is
+* called with a jittered period so that it sometimes runs ahead of the
+* producer (underruns) and sometimes falls behind it.
+****************************************************************************/
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "SDL.h"
+
+void (*fake_audio_sink)( const Uint8 *stream, int len ) = NULL;
+
+static pthread_mutex_t AudioLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_t Device;
+static SDL_AudioSpec Spec;
+static volatile int IsOpen = 0;
+static volatile int IsPaused = 1;
+
+static void *DeviceThread( void * )
+{
+  Uint8 *stream = new Uint8[Spec.size];
+  unsigned int seed = 1;
+  while( IsOpen )
+  {
+    SDL_LockAudio();
+    if( !IsPaused )
+    {
+      Spec.callback( Spec.userdata, stream, Spec.size );
+      if( fake_audio_sink ) fake_audio_sink( stream, Spec.size );
+    }
+    SDL_UnlockAudio();
+    usleep( rand_r( &seed ) % 400 );
+  }
+  delete[] stream;
+  return NULL;
+}
+
+int SDL_OpenAudio( SDL_AudioSpec *desired, SDL_AudioSpec *obtained )
+{
+  if( IsOpen ) return -1;
+  Spec = *desired;
+  Spec.size = Spec.samples * Spec.channels * 2;
+  if( obtained ) *obtained = Spec;
+  IsPaused = 1;
+  IsOpen = 1;
+  return pthread_create( &Device, NULL, DeviceThread, NULL ) == 0 ? 0 : -1;
+}
+
+void SDL_CloseAudio()
+{
+  if( !IsOpen ) return;
+  IsOpen = 0;
+  pthread_join( Device, NULL );
+}
+
+void SDL_PauseAudio( int pause_on )
+{
+  SDL_LockAudio();
+  IsPaused = pause_on;
+  SDL_UnlockAudio();
+}
+
+void SDL_LockAudio()
+{
+  pthread_mutex_lock( &AudioLock );
+}
+
+void SDL_UnlockAudio()
+{
+  pthread_mutex_unlock( &AudioLock );
+}
+
+void SDL_Delay( Uint32 ms )
+{
+  usleep( ms * 1000 );
+}
@@ -0,0 +1,323 @@
+/****************************************************************************
+* maria_test.cpp
+*
+* Maria's line RAM to pixel conversion against the original per-pixel one.
+* Randomized display lists are rendered a frame at a time, in both surface
+* layouts, with the read mode and palette registers changing between lines
+* (as display list interrupts do) and some frames repeated unchanged (so
+* rows are skipped). Each displayed row is also converted from the line RAM
+* it was written from by the original maria_GetColor code and has to be
+* bit-exact with what Maria wrote. Some runs of frames only use read mode 0,
+* they have to come out narrow, and a repeated frame rendered again must
+* leave no row dirty once it is fit to one width. Objects at the end of line
+* RAM are checked against the original cell stores.
+*
+* Maria.cpp is included so that its line RAM can be inspected, the rest of
+* the emulator is replaced by the stubs below.
+****************************************************************************/
+
+#include <stdlib.h>
+
+// glibc's sys/types.h already has a ulong, Logger.h typedefs its own
+#include <sys/types.h>
+#define ulong host_ulong
+#include "Maria.cpp"
+
+#include "test.h"
+
+#define TEST_FRAMES 120
+#define TEST_DLL 0x1800
+#define TEST_DL 0x1900
+#define TEST_GRAPHICS 0x8000
+
+byte memory_ram[MEMORY_SIZE];
+byte* memory_page[MEMORY_PAGES];
+uint memory_pageVersion[MEMORY_PAGES];
+unsigned int wii_lightgun_flash = 0;
+bool lightgun_enabled = false;
+
+static word surface[MARIA_SURFACE_ROWS + 3][MARIA_SURFACE_WIDTH];
+
+void memory_Watch(byte) { }
+uint sally_ExecuteNMI( ) { return 7; }
+unsigned char* wii_sdl_get_blit_addr( ) { return (unsigned char*)surface; }
+
+static byte palette[256 * 3];
+static word expected[MARIA_SURFACE_ROWS][MARIA_SURFACE_WIDTH];
+static bool written[MARIA_SURFACE_ROWS];
+static unsigned int seed = 5;
+
+static uint Random(uint range) {
+  return rand_r(&seed) % range;
+}
+
+// ----------------------------------------------------------------------------
+// The original conversion, one palette register lookup per pixel
+// ----------------------------------------------------------------------------
+static word OldColor(byte data) {
+  byte color = (data & 3)? memory_ram[BACKGRND + data]: memory_ram[BACKGRND];
+  uint r = palette[(color * 3) + 0];
+  uint g = palette[(color * 3) + 1];
+  uint b = palette[(color * 3) + 2];
+  return ((r >> 3) << 11) | ((g >> 2) << 5) | (b >> 3);
+}
+
+static void OldWriteLineRAM(word* buffer, const byte* lineRAM) {
+  byte rmode = memory_ram[CTRL] & 3;
+  int pixel = 0;
+  for(int index = 0; index < MARIA_LINERAM_SIZE; index++) {
+    byte data = lineRAM[index];
+    if(rmode == 0) {
+      buffer[pixel++] = OldColor(data);
+      buffer[pixel++] = OldColor(data);
+    }
+    else if(rmode == 2) {
+      buffer[pixel++] = OldColor((data & 16) | ((data & 8) >> 3) | (data & 2));
+      buffer[pixel++] = OldColor((data & 16) | ((data & 4) >> 2) | ((data & 1) << 1));
+    }
+    else {
+      buffer[pixel++] = OldColor(data & 30);
+      buffer[pixel++] = OldColor((data & 28) | ((data & 1) << 1));
+    }
+  }
+}
+
+// ----------------------------------------------------------------------------
+// Random display state, the registers are the 32 from BACKGRND (palettes,
+// CTRL and CHARBASE included)
+// ----------------------------------------------------------------------------
+static void RandomRegisters(bool narrow) {
+  memory_ram[BACKGRND] = Random(256);
+  for(uint index = 1; index < 32; index++) {
+    if(index & 3) {
+      memory_ram[BACKGRND + index] = Random(256);
+    }
+  }
+  static const byte RMODES[3] = {0, 2, 3};
+  memory_ram[CTRL] = 64 | (Random(2)? 16: 0) | (Random(2)? 4: 0) | (narrow? 0: RMODES[Random(3)]);
+  memory_ram[CHARBASE] = 0x80 + Random(0x70);
+}
+
+static void RandomDisplayList( ) {
+  for(uint address = TEST_GRAPHICS; address < MEMORY_SIZE; address++) {
+    memory_ram[address] = Random(256);
+  }
+  word dll = TEST_DLL;
+  word dl = TEST_DL;
+  for(uint lines = 0; lines < 300; ) {
+    byte offset = Random(16);
+    memory_ram[dll++] = (Random(2)? 32: 0) | offset;
+    memory_ram[dll++] = dl >> 8;
+    memory_ram[dll++] = dl & 255;
+    lines += offset + 1;
+    for(uint objects = Random(9); objects > 0; objects--) {
+      if(Random(2)) {
+        memory_ram[dl++] = Random(256);
+        memory_ram[dl++] = (Random(8) << 5) | (1 + Random(31));
+        memory_ram[dl++] = 0x80 + Random(0x70);
+        memory_ram[dl++] = Random(256);
+      }
+      else {
+        memory_ram[dl++] = Random(256);
+        memory_ram[dl++] = 64 | (Random(2)? 128: 0) | (Random(2)? 32: 0);
+        memory_ram[dl++] = Random(2)? 0x80 + Random(0x70): 0x40 + Random(0x10);
+        memory_ram[dl++] = (Random(8) << 5) | Random(32);
+        memory_ram[dl++] = Random(256);
+      }
+    }
+    memory_ram[dl++] = 0;
+    memory_ram[dl++] = 0;
+  }
+  memory_ram[DPPH] = TEST_DLL >> 8;
+  memory_ram[DPPL] = TEST_DLL & 255;
+  maria_FlushCache( );
+}
+
+// ----------------------------------------------------------------------------
+// RenderFrame
+// Renders the frame with the registers each line was given, converting the
+// line RAM of each displayed row with the original code as well.
+// ----------------------------------------------------------------------------
+static byte registers[263][32];
+
+static void RenderFrame( ) {
+  for(uint row = 0; row < MARIA_SURFACE_ROWS; row++) {
+    written[row] = false;
+  }
+  for(maria_scanline = 1; maria_scanline < 263; maria_scanline++) {
+    memcpy(memory_ram + BACKGRND, registers[maria_scanline], 32);
+    if(maria_scanline > maria_displayArea.top && 
+       maria_scanline <= maria_displayArea.bottom &&
+       maria_scanline >= maria_visibleArea.top && 
+       maria_scanline <= maria_visibleArea.bottom) {
+      uint row = maria_scanline - maria_displayArea.top;
+      OldWriteLineRAM(expected[row], maria_lineRAM);
+      written[row] = true;
+    }
+    maria_RenderScanline( );
+  }
+}
+
+// ----------------------------------------------------------------------------
+// CheckFrame
+// ----------------------------------------------------------------------------
+static uint CheckFrame(uint& dirty) {
+  maria_Fit( );
+  bool narrow = maria_IsNarrow( );
+  uint mismatches = 0;
+  for(uint row = 0; row < MARIA_SURFACE_ROWS; row++) {
+    if(!written[row]) {
+      continue;
+    }
+    word pixels[MARIA_SURFACE_WIDTH];
+    for(uint x = 0; x < MARIA_SURFACE_WIDTH; x++) {
+      pixels[x] = *(word*)maria_GetPixel(narrow? (x >> 1): x, row);
+    }
+    if(memcmp(pixels, expected[row], sizeof(pixels))) {
+      mismatches++;
+    }
+    dirty += maria_IsDirty(row, 1);
+  }
+  maria_ClearDirty( );
+  return mismatches;
+}
+
+static void TestLayout(byte layout) {
+  maria_layout = layout;
+  maria_Reset( );
+  uint mismatches = 0;
+  uint rows = 0;
+  uint dirty = 0;
+  uint wide = 0;
+  for(uint frame = 0; frame < TEST_FRAMES; frame++) {
+    // Every third frame is the same as the one before, its rows are skipped.
+    // Every other run of three frames only uses read mode 0.
+    bool narrow = (frame % 6) >= 3;
+    if((frame % 3) != 2) {
+      RandomDisplayList( );
+      RandomRegisters(narrow);
+      for(uint scanline = 1; scanline < 263; scanline++) {
+        if(Random(8) == 0) {
+          RandomRegisters(narrow);
+        }
+        memcpy(registers[scanline], memory_ram + BACKGRND, 32);
+      }
+    }
+    RenderFrame( );
+    uint changed = 0;
+    mismatches += CheckFrame(changed);
+    // Rendered once more, nothing is left to change
+    if((frame % 3) == 2) {
+      RenderFrame( );
+      mismatches += CheckFrame(dirty);
+    }
+    if(narrow) {
+      CHECK(maria_IsNarrow( ));
+    }
+    else {
+      wide += !maria_IsNarrow( );
+    }
+    for(uint row = 0; row < MARIA_SURFACE_ROWS; row++) {
+      rows += written[row];
+    }
+  }
+  CHECK(mismatches == 0);
+  CHECK(dirty == 0);
+  CHECK(wide > 0);
+  CHECK(maria_linesSkipped > 0);
+  printf("%s layout: %u rows, %u skipped, %u mismatched, %u dirty when repeated\n", 
+    layout == MARIA_LAYOUT_TILED? "tiled": "linear", rows, 
+    maria_linesSkipped, mismatches, dirty);
+}
+
+// ----------------------------------------------------------------------------
+// The original cell stores, a cell at a time
+// ----------------------------------------------------------------------------
+static void OldStoreCell(byte* lineRAM, byte& horizontal, byte cell, byte palette) {
+  if(horizontal < MARIA_LINERAM_SIZE) {
+    if(cell) {
+      lineRAM[horizontal] = palette | cell;
+    }
+    else if(memory_ram[CTRL] & 4) {
+      lineRAM[horizontal] = 0;
+    }
+  }
+  horizontal++;
+}
+
+static void OldStoreObject(byte* lineRAM, word pp, byte width, byte palette, bool wmode, byte horizontal) {
+  for(byte index = 0; index < width; index++) {
+    byte data = memory_ram[pp + index];
+    if(wmode) {
+      OldStoreCell(lineRAM, horizontal, (data & 12) | ((data & 192) >> 6), palette & 16);
+      OldStoreCell(lineRAM, horizontal, ((data & 48) >> 4) | ((data & 3) << 2), palette & 16);
+    }
+    else {
+      OldStoreCell(lineRAM, horizontal, (data & 192) >> 6, palette);
+      OldStoreCell(lineRAM, horizontal, (data & 48) >> 4, palette);
+      OldStoreCell(lineRAM, horizontal, (data & 12) >> 2, palette);
+      OldStoreCell(lineRAM, horizontal, data & 3, palette);
+    }
+  }
+}
+
+// ----------------------------------------------------------------------------
+// TestLineRAMEnd
+// Objects starting at the last horizontal positions, whose cells run past
+// the end of line RAM and wrap around to the left edge.
+// ----------------------------------------------------------------------------
+static void TestLineRAMEnd( ) {
+  uint mismatches = 0;
+  for(uint kangaroo = 0; kangaroo < 2; kangaroo++) {
+    for(byte horizontal = 250; horizontal != 0; horizontal++) {
+      for(uint wmode = 0; wmode < 2; wmode++) {
+        memory_ram[CTRL] = 64 | (kangaroo? 4: 0);
+        byte expected[MARIA_LINERAM_SIZE] = {0};
+        word dl = TEST_DL;
+        // A filler object under the wrapped cells, then the one at the end
+        for(uint object = 0; object < 2; object++) {
+          byte width = 2 + Random(6);
+          byte palette = Random(8) << 2;
+          byte position = object? horizontal: 0;
+          bool write = object && wmode;
+          word pp = TEST_GRAPHICS + Random(0x7000);
+          memory_ram[dl++] = pp & 255;
+          memory_ram[dl++] = 64 | (write? 128: 0);
+          memory_ram[dl++] = pp >> 8;
+          memory_ram[dl++] = (palette << 3) | ((~(width - 1)) & 31);
+          memory_ram[dl++] = position;
+          OldStoreObject(expected, pp, width, palette, write, position);
+        }
+        memory_ram[dl++] = 0;
+        memory_ram[dl++] = 0;
+
+        maria_FlushCache( );
+        maria_zone = 0;
+        maria_offset = 0;
+        maria_h08 = maria_h16 = 0;
+        maria_dp.w = TEST_DL;
+        maria_StoreLineRAM( );
+        if(memcmp(maria_lineRAM, expected, MARIA_LINERAM_SIZE)) {
+          mismatches++;
+        }
+      }
+    }
+  }
+  CHECK(mismatches == 0);
+  printf("line RAM end: %u mismatched\n", mismatches);
+}
+
+int main( ) {
+  for(uint page = 0; page < MEMORY_PAGES; page++) {
+    memory_page[page] = memory_ram + (page << 8);
+  }
+  for(uint index = 0; index < sizeof(palette); index++) {
+    palette[index] = Random(256);
+  }
+  maria_SetPalette(palette);
+
+  TestLayout(MARIA_LAYOUT_LINEAR);
+  TestLayout(MARIA_LAYOUT_TILED);
+  TestLineRAMEnd( );
+  return TEST_RESULT("maria_test");
+}
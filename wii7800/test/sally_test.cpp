@@ -0,0 +1,223 @@
+/****************************************************************************
+* sally_test.cpp
+*
+* Sally's engines against each other. A small program (a loop writing to
+* RAM, an idle loop waiting on RAM and one waiting on the RIOT) is run a
+* scanline at a time by the interpreter, run and verify engines, which all
+* have to end every run in the same state. The verify engine then has to
+* catch a stale decode cache (ROM changed in place) and an idle loop skip
+* over a RIOT change the timer did not announce.
+*
+* Sally.cpp is included, memory and the RIOT are replaced by the stubs
+* below. The program runs from a separate ROM buffer, as cartridges do, so
+* that it is cached.
+****************************************************************************/
+
+#include <vector>
+
+// glibc's sys/types.h already has a ulong, Logger.h typedefs its own
+#include <sys/types.h>
+#define ulong host_ulong
+#include "Sally.cpp"
+
+#include "test.h"
+
+#define TEST_RUNS 3000
+#define TEST_BUDGET (114 * 4)
+#define TEST_ROM 0xf000
+#define TEST_INTIM 0x284
+
+byte memory_ram[MEMORY_SIZE];
+byte* memory_page[MEMORY_PAGES];
+byte* memory_readMap[MEMORY_PAGES];
+byte* memory_writeMap[MEMORY_PAGES];
+bool high_score_set = false;
+uint riot_clock = 0;
+uint riot_deadline = RIOT_IDLE;
+
+static byte rom[MEMORY_SIZE - TEST_ROM];
+// The clock at which the fake INTIM turns non-zero, and whether the timer
+// announces it
+static uint timerChange = 0;
+static bool timerHonest = true;
+
+bool memory_IsPlain(word address, bool write) {
+  if(address < 0x40 || (address >= 640 && address < 768)) {
+    return false;
+  }
+  return !write || address < TEST_ROM;
+}
+
+byte memory_ReadSlow(word address) {
+  if(address == TEST_INTIM) {
+    return (int)(riot_clock - timerChange) >= 0;
+  }
+  return memory_page[address >> 8][address & 255];
+}
+
+void memory_WriteSlow(word address, byte data) {
+  if(address < TEST_ROM) {
+    memory_ram[address] = data;
+  }
+}
+
+void riot_Event( ) {
+  riot_deadline += RIOT_IDLE;
+}
+
+uint riot_TimerStable( ) {
+  if(timerHonest && (int)(riot_clock - timerChange) < 0) {
+    return timerChange;
+  }
+  return riot_deadline;
+}
+
+static const byte PROGRAM[] = {
+  0xa2, 0x00,             // f000 start: ldx #0
+  0x8a,                   // f002 loop:  txa
+  0x18,                   // f003        clc
+  0x65, 0x81,             // f004        adc $81
+  0x9d, 0x00, 0x04,       // f006        sta $0400,x
+  0xe8,                   // f009        inx
+  0xd0, 0xf6,             // f00a        bne loop
+  0xe6, 0x81,             // f00c        inc $81
+  0xa5, 0x80,             // f00e wait:  lda $80
+  0xf0, 0xfc,             // f010        beq wait
+  0xa9, 0x00,             // f012        lda #0
+  0x85, 0x80,             // f014        sta $80
+  0xad, 0x84, 0x02,       // f016 timer: lda INTIM
+  0xf0, 0xfb,             // f019        beq timer
+  0x4c, 0x00, 0xf0        // f01b        jmp start
+};
+
+// The state at the end of a run
+struct State {
+  uint total;
+  uint clock;
+  word pc;
+  byte a, x, y, s, p;
+
+  bool operator==(const State& state) const {
+    return total == state.total && clock == state.clock && pc == state.pc &&
+      a == state.a && x == state.x && y == state.y && s == state.s && 
+      p == state.p;
+  }
+};
+
+struct Result {
+  std::vector<State> states;
+  std::vector<byte> ram;
+};
+
+// ----------------------------------------------------------------------------
+// Run
+// Runs the program from reset, a scanline at a time. Every 40 runs the idle
+// loop is released (as a display list interrupt would) and the timer is set
+// to change a few scanlines later.
+// ----------------------------------------------------------------------------
+static Result Run(byte engine) {
+  memset(memory_ram, 0, sizeof(memory_ram));
+  memset(rom, 0xea, sizeof(rom));
+  memcpy(rom, PROGRAM, sizeof(PROGRAM));
+  for(uint page = 0; page < MEMORY_PAGES; page++) {
+    memory_page[page] = memory_ram + (page << 8);
+    if(page >= (TEST_ROM >> 8)) {
+      memory_page[page] = rom + ((page << 8) - TEST_ROM);
+    }
+    bool registers = page == 0 || page == 2;
+    memory_readMap[page] = registers? NULL: memory_page[page];
+    memory_writeMap[page] = (registers || page >= (TEST_ROM >> 8))? NULL: memory_page[page];
+  }
+  riot_clock = 0;
+  riot_deadline = RIOT_IDLE;
+  timerChange = 0;
+
+  sally_engine = engine;
+  sally_Reset( );
+  sally_pc.w = TEST_ROM;
+  sally_s = 0xff;
+
+  Result result;
+  for(uint run = 0; run < TEST_RUNS; run++) {
+    if(run % 40 == 20) {
+      memory_ram[0x80] = 1;
+      timerChange = riot_clock + 2000;
+    }
+    State state;
+    state.total = sally_Run(TEST_BUDGET, false);
+    sally_SyncFlags( );
+    state.clock = riot_clock;
+    state.pc = sally_pc.w;
+    state.a = sally_a;
+    state.x = sally_x;
+    state.y = sally_y;
+    state.s = sally_s;
+    state.p = sally_p;
+    result.states.push_back(state);
+  }
+  result.ram.assign(memory_ram, memory_ram + MEMORY_SIZE);
+  return result;
+}
+
+static bool Same(const Result& left, const Result& right) {
+  return left.states == right.states && left.ram == right.ram;
+}
+
+// ----------------------------------------------------------------------------
+// TestEngines
+// ----------------------------------------------------------------------------
+static void TestEngines( ) {
+  Result interpreter = Run(SALLY_ENGINE_INTERPRETER);
+  Result run = Run(SALLY_ENGINE_RUN);
+  CHECK(sally_idleSkips > 0);
+  uint skips = sally_idleSkips;
+  Result verify = Run(SALLY_ENGINE_VERIFY);
+  CHECK(sally_verifyErrors == 0);
+  CHECK(sally_idleSkips == 0);
+  CHECK(Same(interpreter, run));
+  CHECK(Same(interpreter, verify));
+  printf("engines: %u idle loop skips, %u verify errors\n", skips, sally_verifyErrors);
+}
+
+// ----------------------------------------------------------------------------
+// TestStaleDecode
+// The ROM is changed in place, behind the decode cache.
+// ----------------------------------------------------------------------------
+static void TestStaleDecode( ) {
+  sally_verifyErrors = 0;
+  Run(SALLY_ENGINE_VERIFY);
+  CHECK(sally_verifyErrors == 0);
+
+  // adc $81 becomes eor $81
+  rom[4] = 0x45;
+  sally_pc.w = TEST_ROM;
+  for(uint run = 0; run < 10; run++) {
+    sally_Run(TEST_BUDGET, false);
+  }
+  CHECK(sally_verifyErrors > 0);
+  printf("stale decode: %u verify errors\n", sally_verifyErrors);
+}
+
+// ----------------------------------------------------------------------------
+// TestUnannouncedChange
+// The timer does not announce when INTIM changes, so the idle loop waiting
+// on it is skipped past the change.
+// ----------------------------------------------------------------------------
+static void TestUnannouncedChange( ) {
+  timerHonest = false;
+  Result interpreter = Run(SALLY_ENGINE_INTERPRETER);
+  Result run = Run(SALLY_ENGINE_RUN);
+  CHECK(!Same(interpreter, run));
+  Result verify = Run(SALLY_ENGINE_VERIFY);
+  CHECK(sally_verifyErrors > 0);
+  CHECK(Same(interpreter, verify));
+  printf("unannounced change: %u verify errors\n", sally_verifyErrors);
+  timerHonest = true;
+}
+
+int main( ) {
+  TestEngines( );
+  TestStaleDecode( );
+  TestUnannouncedChange( );
+  return TEST_RESULT("sally_test");
+}
@@ -0,0 +1,28 @@
+/****************************************************************************
+* test.h
+*
+* Checks for the host tests, a failed check is reported and makes the test
+* exit with an error once it is done
+****************************************************************************/
+
+#ifndef TEST_H
+#define TEST_H
+
+#include <stdio.h>
+
+static int test_failures = 0;
+
+#define CHECK( cond ) \
+  do { \
+    if( !( cond ) ) { \
+      fprintf( stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, \
+        #cond ); \
+      test_failures++; \
+    } \
+  } while( 0 )
+
+#define TEST_RESULT( name ) \
+  ( printf( "%s: %s\n", name, test_failures ? "FAILED" : "passed" ), \
+    test_failures ? 1 : 0 )
+
+#endif